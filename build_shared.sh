@@ -5,4 +5,4 @@
 
 rm -f libasr-server.so
 
-g++ -Wall -Wno-write-strings -shared -std=c++17 -O3 -fPIC -I./boost_1_76_0/ -I./inc/ -I../dLabPro_vosk_api/programs/recognizer/ -o libasr-server.so src/asr_server.cpp src/vosk_dlabpro_wrapper.c -lpthread -ldl
+g++ -Wall -Wno-write-strings -shared -std=c++17 -O3 -fPIC -I./boost_1_76_0/ -I./inc/ -I../dLabPro_vosk_api/programs/recognizer/ -o libasr-server.so src/asr_server.cpp src/vosk_dlabpro_wrapper.c src/vosk_batch.c src/sample_ring.c src/logger.c src/metrics.c src/json_buffer.c src/control_message.c src/resampler.c src/voice_filter.c src/pcm_convert.c -lpthread -ldl
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+rm -f ingest_benchmark
+
+g++ -Wall -std=c++17 -O3 -I./src/ -o ingest_benchmark tools/ingest_benchmark.c src/pcm_convert.c -lpthread
+
+rm -f control_message_test
+
+g++ -Wall -std=c++17 -O3 -I./src/ -o control_message_test tools/control_message_test.c src/control_message.c && ./control_message_test
+
+rm -f load_generator
+
+g++ -Wall -std=c++17 -O3 -I./boost_1_76_0/ -o load_generator tools/load_generator.cpp -lpthread
+
+# asr_server against the mock recognizer instead of dLabPro, needs the portaudio headers (portaudio19-dev)
+rm -f asr_server_mock
+
+g++ -Wall -Wno-write-strings -std=c++17 -O3 -I./boost_1_76_0/ -I./inc/ -I./tools/mock_recognizer/ -o asr_server_mock src/asr_server.cpp src/vosk_dlabpro_wrapper.c src/vosk_batch.c src/sample_ring.c src/logger.c src/metrics.c src/json_buffer.c src/control_message.c src/resampler.c src/voice_filter.c src/pcm_convert.c tools/mock_recognizer/mock_recognizer.c -lpthread
+
+# the worker handover against the mock recognizer
+rm -f handover_test
+
+g++ -Wall -Wno-write-strings -std=c++17 -O3 -I./inc/ -I./tools/mock_recognizer/ -o handover_test tools/handover_test.c src/vosk_dlabpro_wrapper.c src/vosk_batch.c src/sample_ring.c src/logger.c src/metrics.c src/json_buffer.c src/resampler.c src/voice_filter.c src/pcm_convert.c tools/mock_recognizer/mock_recognizer.c -lpthread && ./handover_test
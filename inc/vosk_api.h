@@ -309,8 +309,10 @@ void vosk_gpu_thread_init();
 
 /** Creates the batch recognizer object
  *
+ *  @param model_path the path of the model, as for vosk_model_new(); a model
+ *                    already loaded with that path shares its recognizers
  *  @returns model object or NULL if problem occured */
-VoskBatchModel *vosk_batch_model_new();
+VoskBatchModel *vosk_batch_model_new(const char *model_path);
 
 /** Releases batch model object */
 void vosk_batch_model_free(VoskBatchModel *model);
@@ -0,0 +1,150 @@
+/* Extensions of the Vosk API that are specific to the dLabPro wrapper */
+
+#ifndef VOSK_DLABPRO_WRAPPER_H
+#define VOSK_DLABPRO_WRAPPER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* see vosk_api.h */
+struct VoskRecognizer;
+
+/** Notifies the wrapper about a busy/idle transition of the recognizer
+ *
+ *  To be called by the dLabPro recognizer thread right after it changed
+ *  the value of recognizer_get_busy_counter() or recognizer_get_idle_counter().
+ *  The wrapper hands it to recognizer_set_state_callback() of
+ *  recognizer_vosk_wrapper.h if the recognizer has it (it needs a patch for
+ *  that, the mock recognizer has it).
+ *  The wrapper feeds the next block once the recognizer is idle again; with
+ *  the notifications it is woken up right then. Without them nothing tells
+ *  it when a block is done, so as a fallback it checks the counters when the
+ *  block should be done by the time recent blocks took, and then every 1 ms. */
+void vosk_dlabpro_notify_state(void);
+
+/** Sets the number of recognizer worker processes
+ *
+ *  The dLabPro recognizer keeps its state in globals, so every additional
+ *  recognizer needs a process of its own. Each session is bound to a free
+ *  worker, so up to @param workers sessions are decoded in parallel.
+ *
+ *  Must be called before the first vosk_model_new(). The workers are forked
+ *  from there, so vosk_model_new() must be called before the caller starts
+ *  any threads. Along with them it forks a spawner process which forks the
+ *  workers of vosk_dlabpro_reload() later on, when the caller has threads
+ *  running. Every recognizer configuration (model path) gets workers and a
+ *  spawner of its own.
+ *
+ *  @param workers number of worker processes per configuration, 0 (default)
+ *                 runs the one and only recognizer within this process,
+ *                 which allows only one configuration */
+void vosk_dlabpro_set_workers(int workers);
+
+/** Returns how many recognizers decode in parallel
+ *
+ *  That is the number of worker processes, or 1 if the recognizer runs
+ *  within this process. The batch API starts one thread per recognizer. */
+int vosk_dlabpro_get_parallel_recognizers(void);
+
+/** Gets the recognizers of all models ready for the first sessions
+ *
+ *  Waits for every recognizer to come online, then decodes @param warmup_ms
+ *  of synthetic audio with it, so the first sessions do not pay for loading
+ *  the model memory. The results of that audio are discarded. Worker
+ *  processes warm up in parallel.
+ *
+ *  To be called after the last vosk_model_new(), before accepting sessions.
+ *
+ *  @param timeout_ms how long a recognizer may take to come online
+ *  @return 1 if every model has a recognizer online, 0 otherwise */
+int vosk_dlabpro_warm_up(int warmup_ms, int timeout_ms);
+
+/** Returns 1 once vosk_dlabpro_warm_up() succeeded, as long as every model
+ *  still has a recognizer (worker processes may die), 0 otherwise */
+int vosk_dlabpro_ready(void);
+
+/** Replaces the recognizers by new ones, without interrupting the sessions
+ *
+ *  Starts new worker processes for every model, which read the configuration
+ *  as it is now, and warms them up like vosk_dlabpro_warm_up(). Meanwhile the
+ *  old workers keep serving. Then the new workers take over: new sessions get
+ *  them right away, the others move at their next utterance boundary (or when
+ *  they stop sending), and each old worker ends once its session moved on.
+ *
+ *  Blocks until the last old worker ended, so call it from a thread of its
+ *  own. Needs worker processes (see vosk_dlabpro_set_workers()).
+ *
+ *  @return 1 when done, 0 if the new recognizers did not come online (the
+ *          old ones stay then), or another reload is running */
+int vosk_dlabpro_reload(int warmup_ms, int timeout_ms);
+
+/** Configures the silence filter of recognizer instances created afterwards
+ *
+ *  Frames of 10ms are voiced if their energy reaches @param threshold_db
+ *  (dB relative to full scale), noise-like frames (many zero crossings) need
+ *  10dB more. Only voiced frames, @param hangover_ms after them and
+ *  @param preroll_ms before them reach the recognizer. The hangover has to
+ *  be long enough for the recognizer to end an utterance.
+ *
+ *  Enabled by default with -50dB, 1000ms hangover and 300ms pre-roll. */
+void vosk_dlabpro_set_voice_filter(int enabled, float threshold_db, int hangover_ms, int preroll_ms);
+
+/** Scheduling policies, see vosk_dlabpro_set_scheduler() */
+#define VOSK_DLABPRO_SCHEDULE_FIFO   0    /* the session waiting longest goes first */
+#define VOSK_DLABPRO_SCHEDULE_SPEECH 1    /* sessions with speech queued go first, then FIFO */
+
+/** Configures how the sessions share the recognizers
+ *
+ *  A session keeps its recognizer while somebody talks. Sessions without a
+ *  recognizer queue their audio and get one when it is free, its session
+ *  stopped sending, or its session is between two utterances. Waiting sessions
+ *  are served in the order given by @param policy (default FIFO).
+ *
+ *  @param queue_ms audio queued per session at most (default 10000),
+ *                  the oldest audio is dropped beyond that */
+void vosk_dlabpro_set_scheduler(int policy, int queue_ms);
+
+/** Sets how often vosk_dlabpro_partial_result_changes() hands out a changed partial result
+ *
+ *  @param interval_ms time since the last partial result of the instance,
+ *                     0 (default) hands out every change */
+void vosk_dlabpro_set_partial_interval(int interval_ms);
+
+/** Like vosk_recognizer_partial_result(), but only if the partial result changed
+ *
+ *  Returns NULL if the partial result is the same as the last one handed
+ *  out for @param recognizer (or the empty one after a final result), or if
+ *  it changed within the interval set by vosk_dlabpro_set_partial_interval().
+ *  A change held back that way comes with a later call. */
+const char *vosk_dlabpro_partial_result_changes(struct VoskRecognizer *recognizer);
+
+/** Changes the sample rate of the audio passed to @param recognizer
+ *
+ *  For clients telling their rate once the session is open, so the
+ *  recognizers of one server can serve different rates; meant to be called
+ *  before the first audio, audio carried over at the old rate is dropped.
+ *  Returns 0 if @param sample_rate cannot be converted, the rate stays as it was. */
+int vosk_dlabpro_set_sample_rate(struct VoskRecognizer *recognizer, float sample_rate);
+
+/** Tells that audio for @param recognizer arrived, before it is passed on
+ *
+ *  Sessions lose their recognizer worker to waiting ones when no audio
+ *  arrived for a while; a server whose calls may wait for a thread calls
+ *  this as the audio comes in, so such waits do not count as silence.
+ *  Thread safe, also against calls for the same recognizer. */
+void vosk_dlabpro_audio_received(struct VoskRecognizer *recognizer);
+
+/** Tells whether vosk_recognizer_final_result() can run without waiting
+ *
+ *  The final result decodes the audio a session queued, which may have to
+ *  wait for a recognizer worker (at most 10s, then the audio is dropped).
+ *  Returns 1 once that is not necessary any more; a server polls this
+ *  instead of blocking one of its threads in vosk_recognizer_final_result(). */
+int vosk_dlabpro_final_ready(struct VoskRecognizer *recognizer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VOSK_DLABPRO_WRAPPER_H */
@@ -5,41 +5,109 @@
 //------------------------------------------------------------------------------
 
 #include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <csignal>
 #include <cstdlib>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
-#include <string_view>
+
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "vosk_api.h"
+#include "vosk_dlabpro_wrapper.h"
+#include "control_message.h"
+#include "logger.h"
+#include "metrics.h"
 
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
 namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
 namespace net = boost::asio;            // from <boost/asio.hpp>
 using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+using local = boost::asio::local::stream_protocol;
+// Sessions run on TCP connections from clients as well as on Unix socket connections from the router
+using stream_protocol = boost::asio::generic::stream_protocol;
 
 //------------------------------------------------------------------------------
-static VoskModel *model;
+// Recognizer configurations by name, the first one also serves sessions without a name
+static std::vector<std::pair<std::string, VoskModel *>> models;
+
+// The model named by the URL path of a websocket request (ws://host:port/name), nullptr if unknown
+static VoskModel *find_model(beast::string_view target)
+{
+    target = target.substr(0, target.find('?'));
+    while (!target.empty() && (target.front() == '/'))
+        target.remove_prefix(1);
+
+    if (target.empty())
+        return models.front().second;
+
+    for (auto const &entry : models)
+        if (entry.first == target)
+            return entry.second;
+
+    return nullptr;
+}
+
+// Blocking recognizer calls run here, never on the io_context threads
+static net::thread_pool *decoder;
 
 struct Args
 {
-    float sample_rate = 8000;
+    float sample_rate = 8000;   // of sessions which do not tell theirs in a config message
     int max_alternatives = 0;
     bool show_words = true;
+    int workers = 0;
+    int decode_threads = 0;
+    int scheduler_policy = VOSK_DLABPRO_SCHEDULE_FIFO;
+    int session_queue_ms = 10000;
+    bool vad_filter = true;
+    float vad_threshold_db = -50;
+    int vad_hangover_ms = 1000;
+    int vad_preroll_ms = 300;
+    bool partial_changes_only = true;
+    int partial_interval_ms = 100;
+    int warmup_ms = 2000;
+    int startup_timeout_ms = 60000;
+    int server_processes = 1;
+    bool router = false;
+    std::string socket_dir = "/tmp";
 };
 
+// Lets several server processes listen on the same port, the kernel spreads the connections
+using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
 // Report a failure
 void fail(beast::error_code ec, char const *what)
 {
-    std::cerr << what << ": " << ec.message() << "\n";
+    // Pending operations of a connection being closed, as every session ends
+    if (ec == net::error::operation_aborted)
+        return;
+
+    logError("%s: %s\n", what, ec.message().c_str());
 }
 
 // Echoes back all received WebSocket messages
@@ -47,165 +115,966 @@ class session : public std::enable_shared_from_this<session>
 {
     struct Chunk
     {
-        std::string_view result;
+        // Copied, rec_ is busy with the next piece while this is written
+        std::string result;
         bool stop = false;
+        bool final = false;
+        bool reply = false; // to a control message, never replaced by a newer result
+        bool retry = false; // the piece waits for a recognizer, it is decoded again later
     };
 
-    websocket::stream<beast::tcp_stream> ws_;
-    beast::flat_buffer buffer_;
+    // Part of a message, audio is decoded as it arrives instead of once the message is complete
+    struct Piece
+    {
+        std::size_t size = 0;   // bytes of audio in the buffer
+        std::string text;       // text messages are collected whole
+        bool is_text = false;
+        bool done = false;      // last piece of its message
+        double received = 0;
+    };
+
+    // Big enough for any piece, which is handed to the decoder from one recognizer block
+    // (PABUF_SIZE 16 bit samples) on, and the next piece is read into the other buffer meanwhile
+    static constexpr std::size_t read_buffer_size = 16384;
+    static constexpr std::size_t block_bytes = 1024;
+
+    // Replies waiting for a slow client pause reading above this, until they are below the low mark
+    static constexpr std::size_t outbox_high_bytes = 65536;
+    static constexpr std::size_t outbox_low_bytes = 16384;
+
+    // Control messages are small, longer text messages end the session
+    static constexpr std::size_t control_max_bytes = 4096;
+
+    // The end of the stream asks this often whether its recognizer is free
+    static constexpr int final_retry_ms = 20;
+
+    websocket::stream<beast::basic_stream<stream_protocol>> ws_;
+    net::steady_timer retry_timer_;
+    http::request<http::string_body> req_;
+    std::array<std::vector<char>, 2> buffers_;
+    std::array<Piece, 2> pieces_;
+    int reading_ = 0;       // buffer the next read goes to
+    bool read_pending_ = false;
+    bool decoding_ = false; // the other buffer is with the decoder
+    bool ready_ = false;    // the piece in pieces_[reading_] waits for the decoder
+    bool accepted_final_ = false; // decoder side: a final result is due at the end of the message
+    std::deque<Chunk> outbox_;
+    std::size_t outbox_bytes_ = 0;
+    bool writing_ = false;  // outbox_.front() is being written
+    bool paused_ = false;   // by the outbox
+    bool stop_ = false;     // the end of the stream was decoded
     VoskRecognizer *rec_;
-    Chunk chunk_;
     Args args_;
 
+    // Statistics of the session, kept by the decoder side
+    double audio_seconds_ = 0;
+    int partial_results_ = 0;
+    int final_results_ = 0;
+
 public:
     // Take ownership of the socket
-    explicit session(tcp::socket &&socket, Args &&args)
-        : ws_(std::move(socket)), args_(std::move(args))
+    explicit session(stream_protocol::socket &&socket, Args &&args, VoskModel *model)
+        : ws_(std::move(socket)), retry_timer_(ws_.get_executor()), args_(std::move(args))
 
     {
+        for (auto &buffer : buffers_)
+            buffer.resize(read_buffer_size);
+
+        // Replies are small and latency matters, do not let them wait for the client's ACK
+        // (fails harmlessly on Unix sockets)
+        beast::error_code ec;
+        beast::get_lowest_layer(ws_).socket().set_option(tcp::no_delay(true), ec);
+
+        metricsGaugeAdd(METRIC_SESSIONS_ACTIVE, 1);
         rec_ = vosk_recognizer_new(model, args.sample_rate);
-        vosk_recognizer_set_max_alternatives(rec_, args.max_alternatives);
-        vosk_recognizer_set_words(rec_, args.show_words);
+        if (rec_)
+        {
+            vosk_recognizer_set_max_alternatives(rec_, args.max_alternatives);
+            vosk_recognizer_set_words(rec_, args.show_words);
+        }
+    }
+
+    ~session()
+    {
+        if (rec_)
+            vosk_recognizer_free(rec_);
+        metricsGaugeAdd(METRIC_SESSIONS_ACTIVE, -1);
+    }
+
+    // Get on the correct executor, req is the upgrade request read by the http_session
+    void
+    run(http::request<http::string_body> req)
+    {
+        req_ = std::move(req);
+
+        // We need to be executing within a strand to perform async operations
+        // on the I/O objects in this session. Although not strictly necessary
+        // for single-threaded contexts, this example code is written to be
+        // thread-safe by default.
+        net::dispatch(ws_.get_executor(),
+                      beast::bind_front_handler(
+                          &session::on_run,
+                          shared_from_this()));
+    }
+
+    // Start the asynchronous operation
+    void
+    on_run()
+    {
+        // We output only text
+        ws_.text(true);
+
+        // Set suggested timeout settings for the websocket
+        ws_.set_option(
+            websocket::stream_base::timeout::suggested(
+                beast::role_type::server));
+
+        // Set a decorator to change the Server of the handshake
+        ws_.set_option(websocket::stream_base::decorator(
+            [](websocket::response_type &res)
+            {
+                res.set(http::field::server,
+                        std::string(BOOST_BEAST_VERSION_STRING) +
+                            " websocket-server-async");
+            }));
+        // Accept the websocket handshake
+        ws_.async_accept(
+            req_,
+            beast::bind_front_handler(
+                &session::on_accept,
+                shared_from_this()));
+    }
+
+    void
+    on_accept(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "accept");
+
+        // The recognizer refused the configuration (e.g. the sample rate)
+        if (!rec_)
+        {
+            ws_.async_close(
+                websocket::close_reason(websocket::close_code::policy_error, "unsupported configuration"),
+                beast::bind_front_handler(
+                    &session::on_close,
+                    shared_from_this()));
+            return;
+        }
+
+        // Read a message
+        do_read();
+    }
+
+    // Reads wait for the decoder, for a slow client, and stop after the end of the stream
+    void
+    maybe_read()
+    {
+        if (read_pending_ || ready_ || paused_ || stop_)
+            return;
+
+        do_read();
+    }
+
+    void
+    do_read()
+    {
+        // Audio continues in the buffer, text is appended to the piece
+        Piece &piece = pieces_[reading_];
+        std::size_t offset = piece.is_text ? 0 : piece.size;
+
+        read_pending_ = true;
+        ws_.async_read_some(
+            net::buffer(buffers_[reading_].data() + offset, read_buffer_size - offset),
+            beast::bind_front_handler(
+                &session::on_read,
+                shared_from_this()));
+    }
+
+    // Partial results go out only when they changed, unless configured otherwise
+    std::optional<Chunk> partial_result()
+    {
+        const char *result = args_.partial_changes_only ?
+            vosk_dlabpro_partial_result_changes(rec_) : vosk_recognizer_partial_result(rec_);
+
+        if (result == nullptr)
+            return std::nullopt;
+
+        return Chunk{result, false};
+    }
+
+    // Text messages are control messages, audio comes in binary messages only
+    std::optional<Chunk> process_control(const std::string &text)
+    {
+        ControlMessage message;
+
+        if (!controlMessageParse(text.data(), static_cast<int>(text.size()), &message))
+        {
+            logError("Invalid control message: %.*s\n", static_cast<int>(std::min<std::size_t>(text.size(), 100)), text.data());
+            return std::nullopt;
+        }
+
+        switch (message.type)
+        {
+        case CONTROL_CONFIG:
+            if (message.maxAlternatives >= 0)
+                vosk_recognizer_set_max_alternatives(rec_, message.maxAlternatives);
+            if (message.words >= 0)
+                vosk_recognizer_set_words(rec_, message.words);
+            // The rate of this session, VOSK_SAMPLE_RATE is only the default
+            if ((message.sampleRate > 0) && (message.sampleRate != args_.sample_rate))
+            {
+                if (!vosk_dlabpro_set_sample_rate(rec_, message.sampleRate))
+                    return Chunk{"{\"error\" : \"unsupported sample rate\"}", true, false, true};
+                args_.sample_rate = message.sampleRate;
+            }
+            return std::nullopt;
+
+        case CONTROL_EOF:
+            // Queued audio may wait for a recognizer, not on this thread
+            if (!vosk_dlabpro_final_ready(rec_))
+                return Chunk{"", false, false, false, true};
+            final_results_++;
+            return Chunk{vosk_recognizer_final_result(rec_), true, true};
+
+        case CONTROL_RESET:
+            vosk_recognizer_reset(rec_);
+            return std::nullopt;
+
+        case CONTROL_STATS:
+        {
+            char stats[256];
+
+            snprintf(stats, sizeof(stats),
+                     "{\"stats\" : {\"sample_rate\" : %g, \"audio_seconds\" : %.3f, \"partial_results\" : %d, \"final_results\" : %d}}",
+                     args_.sample_rate, audio_seconds_, partial_results_, final_results_);
+            return Chunk{stats, false, false, true};
+        }
+
+        default:
+            return std::nullopt;
+        }
+    }
+
+    // Runs on a decode thread, the reply is due with the last piece of a message
+    std::optional<Chunk> process_piece(const Piece &piece, const char *data)
+    {
+        if (piece.is_text)
+        {
+            return process_control(piece.text);
+        }
+
+        audio_seconds_ += piece.size / 2.0 / args_.sample_rate;
+        if ((piece.size > 0) && vosk_recognizer_accept_waveform(rec_, data, static_cast<int>(piece.size)))
+            accepted_final_ = true;
+
+        if (!piece.done)
+            return std::nullopt;
+
+        bool final = accepted_final_;
+        accepted_final_ = false;
+
+        if (final)
+        {
+            final_results_++;
+            return Chunk{vosk_recognizer_result(rec_), false, true};
+        }
+
+        std::optional<Chunk> partial = partial_result();
+        if (partial)
+            partial_results_++;
+        return partial;
+    }
+
+    void
+    on_read(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        read_pending_ = false;
+
+        // This indicates that the session was closed, or is being closed by us
+        if ((ec == websocket::error::closed) || (ec == net::error::operation_aborted))
+            return;
+
+        if (ec)
+            return fail(ec, "read");
+
+        // Nothing after the end of the stream counts
+        if (stop_)
+            return;
+
+        Piece &piece = pieces_[reading_];
+        piece.is_text = ws_.got_text();
+        piece.done = ws_.is_message_done();
+
+        if (piece.is_text)
+            piece.text.append(buffers_[reading_].data(), bytes_transferred);
+        else
+            piece.size += bytes_transferred;
+
+        // The decoder may get to it later, the recognizer must not count that as silence
+        if (!piece.is_text)
+            vosk_dlabpro_audio_received(rec_);
+
+        if (piece.text.size() > control_max_bytes)
+        {
+            stop_ = true;
+            ws_.async_close(
+                websocket::close_reason(websocket::close_code::too_big, "control message too long"),
+                beast::bind_front_handler(
+                    &session::on_close,
+                    shared_from_this()));
+            return;
+        }
+
+        // Small pieces of audio wait for more
+        if (!piece.done && (piece.is_text || (piece.size < block_bytes)))
+            return maybe_read();
+
+        piece.received = metricsTime();
+
+        // Reading pauses until the decoder is done with the other buffer
+        if (decoding_)
+        {
+            ready_ = true;
+            return;
+        }
+
+        start_decode();
+        maybe_read();
+    }
+
+    // Hands the piece read last to the decoder and switches reading to the other buffer
+    void
+    start_decode()
+    {
+        int index = reading_;
+
+        decoding_ = true;
+        reading_ = 1 - reading_;
+        pieces_[reading_] = Piece{};
+
+        post_decode(index);
+    }
+
+    void
+    post_decode(int index)
+    {
+        // Decode off the I/O thread
+        net::post(*decoder,
+                  [self = shared_from_this(), index]
+                  {
+                      const Piece &piece = self->pieces_[index];
+                      std::optional<Chunk> chunk = self->process_piece(piece, self->buffers_[index].data());
+
+                      // Includes the time waiting for a decode thread
+                      if (chunk && !chunk->reply && !chunk->retry)
+                          metricsObserve(chunk->final ? METRIC_FINAL_LATENCY_SECONDS : METRIC_PARTIAL_LATENCY_SECONDS,
+                                         metricsTime() - piece.received);
+
+                      // Continue on the session's strand
+                      net::post(self->ws_.get_executor(),
+                                beast::bind_front_handler(
+                                    &session::on_decoded,
+                                    self,
+                                    index,
+                                    std::move(chunk)));
+                  });
+    }
+
+    void
+    on_decoded(int index, std::optional<Chunk> chunk)
+    {
+        // The piece goes to the decoder again later, the decode thread serves other sessions meanwhile
+        if (chunk && chunk->retry)
+        {
+            retry_timer_.expires_after(std::chrono::milliseconds(final_retry_ms));
+            retry_timer_.async_wait(
+                [self = shared_from_this(), index](beast::error_code ec)
+                {
+                    if (!ec)
+                        self->post_decode(index);
+                });
+            return;
+        }
+
+        decoding_ = false;
+
+        if (chunk)
+        {
+            stop_ = stop_ || chunk->stop;
+            send(std::move(*chunk));
+        }
+
+        if (ready_)
+        {
+            ready_ = false;
+            start_decode();
+        }
+
+        maybe_read();
+    }
+
+    // Replies go out in order, a partial result not sent yet is replaced by
+    // anything newer, final results are never dropped
+    void
+    send(Chunk chunk)
+    {
+        // The front is on its way already
+        std::size_t unsent = outbox_.size() - (writing_ ? 1 : 0);
+
+        if ((unsent > 0) && !outbox_.back().final && !outbox_.back().stop && !outbox_.back().reply)
+        {
+            outbox_bytes_ -= outbox_.back().result.size();
+            outbox_.pop_back();
+            metricsAdd(METRIC_PARTIALS_COALESCED, 1);
+        }
+
+        outbox_bytes_ += chunk.result.size();
+        outbox_.push_back(std::move(chunk));
+
+        if (outbox_bytes_ > outbox_high_bytes)
+            paused_ = true;
+
+        if (!writing_)
+            do_write();
+    }
+
+    void
+    do_write()
+    {
+        writing_ = true;
+
+        ws_.async_write(
+            net::buffer(outbox_.front().result),
+            beast::bind_front_handler(
+                &session::on_write,
+                shared_from_this()));
+    }
+
+    void
+    on_write(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        writing_ = false;
+
+        if (ec)
+            return fail(ec, "write");
+
+        metricsAdd(METRIC_SENT_BYTES, bytes_transferred);
+
+        bool stop = outbox_.front().stop;
+        outbox_bytes_ -= outbox_.front().result.size();
+        outbox_.pop_front();
+
+        // Like the Vosk server, the connection ends with the final result of the stream
+        if (stop)
+            return do_close();
+
+        if (paused_ && (outbox_bytes_ <= outbox_low_bytes))
+        {
+            paused_ = false;
+            maybe_read();
+        }
+
+        if (!outbox_.empty())
+            do_write();
+    }
+
+    void
+    do_close()
+    {
+        ws_.async_close(
+            websocket::close_code::normal,
+            beast::bind_front_handler(
+                &session::on_close,
+                shared_from_this()));
+    }
+
+    void
+    on_close(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "close");
+    }
+};
+
+//------------------------------------------------------------------------------
+
+// Reads the HTTP request of a new connection, hands websocket upgrades
+// over to a session and answers plain requests (GET /metrics) itself
+class http_session : public std::enable_shared_from_this<http_session>
+{
+    beast::basic_stream<stream_protocol> stream_;
+    beast::flat_buffer buffer_;
+    http::request<http::string_body> req_;
+    http::response<http::string_body> res_;
+    Args args_;
+
+public:
+    // Take ownership of the socket
+    explicit http_session(stream_protocol::socket &&socket, Args &&args)
+        : stream_(std::move(socket)), args_(std::move(args))
+    {
+    }
+
+    // Get on the correct executor
+    void
+    run()
+    {
+        net::dispatch(stream_.get_executor(),
+                      beast::bind_front_handler(
+                          &http_session::do_read,
+                          shared_from_this()));
+    }
+
+private:
+    void
+    do_read()
+    {
+        // Clients which connect and send nothing do not stay forever
+        req_ = {};
+        stream_.expires_after(std::chrono::seconds(30));
+
+        http::async_read(
+            stream_,
+            buffer_,
+            req_,
+            beast::bind_front_handler(
+                &http_session::on_read,
+                shared_from_this()));
+    }
+
+    void
+    on_read(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        // The client closed a keep-alive connection
+        if (ec == http::error::end_of_stream)
+            return do_close();
+
+        if (ec)
+            return fail(ec, "read");
+
+        VoskModel *model = websocket::is_upgrade(req_) ? find_model(req_.target()) : nullptr;
+
+        if (model)
+        {
+            // The websocket stream sets its own timeouts
+            stream_.expires_never();
+            std::make_shared<session>(stream_.release_socket(), std::move(args_), model)->run(std::move(req_));
+            return;
+        }
+
+        res_ = {};
+        res_.version(req_.version());
+        res_.keep_alive(req_.keep_alive());
+        res_.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+
+        if (websocket::is_upgrade(req_))
+        {
+            res_.result(http::status::not_found);
+            res_.set(http::field::content_type, "text/plain");
+            res_.body() = "Unknown model\n";
+        }
+        else if ((req_.method() == http::verb::get) && (req_.target() == "/ready"))
+        {
+            // For load balancers and rolling restarts, connections are refused before
+            bool ready = vosk_dlabpro_ready() != 0;
+
+            res_.result(ready ? http::status::ok : http::status::service_unavailable);
+            res_.set(http::field::content_type, "text/plain");
+            res_.body() = ready ? "ready\n" : "not ready\n";
+        }
+        else if ((req_.method() == http::verb::get) && (req_.target() == "/metrics"))
+        {
+            size_t length = 0;
+            char *text = metricsRender(&length);
+
+            res_.result(http::status::ok);
+            res_.set(http::field::content_type, "text/plain; version=0.0.4");
+            if (text)
+                res_.body().assign(text, length);
+            free(text);
+        }
+        else
+        {
+            res_.result(http::status::not_found);
+            res_.set(http::field::content_type, "text/plain");
+            res_.body() = "Not found\n";
+        }
+        res_.prepare_payload();
+
+        http::async_write(
+            stream_,
+            res_,
+            beast::bind_front_handler(
+                &http_session::on_write,
+                shared_from_this()));
+    }
+
+    void
+    on_write(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(bytes_transferred);
+
+        if (ec)
+            return fail(ec, "write");
+
+        if (!res_.keep_alive())
+            return do_close();
+
+        do_read();
+    }
+
+    void
+    do_close()
+    {
+        beast::error_code ec;
+        stream_.socket().shutdown(net::socket_base::shutdown_send, ec);
+    }
+};
+
+//------------------------------------------------------------------------------
+
+// Router mode: the server processes of the supervisor listen on Unix sockets and one
+// more process accepts the clients and relays each connection to one of them
+struct backend
+{
+    std::string path;       // of the Unix socket
+    int process;            // index of the server process, for its load in the metrics
+    int connections = 0;    // relayed by the router right now
+};
+
+static std::vector<backend> backends;
+static std::mutex backends_mutex;
+
+// Affinity key -> backend and connections with that key, kept while any is open,
+// so all participants of a conference end up on the same backend
+static std::unordered_map<std::string, std::pair<int, int>> affinities;
+
+// The value of the affinity parameter of the URL (ws://host:port/name?affinity=conference)
+static std::string affinity_key(beast::string_view target)
+{
+    std::size_t query = target.find('?');
+
+    if (query == beast::string_view::npos)
+        return {};
+
+    target.remove_prefix(query + 1);
+    while (!target.empty())
+    {
+        beast::string_view parameter = target.substr(0, target.find('&'));
+
+        if (parameter.substr(0, 9) == "affinity=")
+            return std::string(parameter.substr(9));
+
+        target.remove_prefix(std::min(target.size(), parameter.size() + 1));
+    }
+    return {};
+}
+
+// The backends in the order to try: the one the key is bound to, then the least loaded.
+// Sessions waiting for a recognizer count most, their audio is not decoded, then the
+// recognizers busy decoding (from their busy/idle counters), then the connections.
+static std::vector<int> rank_backends(std::string const &key)
+{
+    std::vector<std::tuple<long long, long long, int, int>> loads;
+    std::vector<int> order;
+    std::lock_guard<std::mutex> lock(backends_mutex);
+
+    for (int index = 0; index < static_cast<int>(backends.size()); ++index)
+    {
+        backend const &b = backends[index];
+
+        loads.emplace_back(
+            metricsProcessGauge(b.process, METRIC_SESSIONS_WAITING),
+            metricsProcessGauge(b.process, METRIC_RECOGNIZERS_BUSY),
+            b.connections,
+            index);
+    }
+    std::sort(loads.begin(), loads.end());
+
+    auto bound = key.empty() ? affinities.end() : affinities.find(key);
+    if (bound != affinities.end())
+        order.push_back(bound->second.first);
+    for (auto const &load : loads)
+        if ((bound == affinities.end()) || (std::get<3>(load) != bound->second.first))
+            order.push_back(std::get<3>(load));
+    return order;
+}
+
+// A connection of the key goes to the backend, which the key is bound to from now on
+static void route(int index, std::string const &key)
+{
+    std::lock_guard<std::mutex> lock(backends_mutex);
+
+    backends[index].connections++;
+    if (!key.empty())
+    {
+        auto &affinity = affinities[key];
+        affinity.first = index;
+        affinity.second++;
+    }
+}
+
+static void unroute(int index, std::string const &key)
+{
+    std::lock_guard<std::mutex> lock(backends_mutex);
+
+    backends[index].connections--;
+    if (!key.empty())
+    {
+        auto it = affinities.find(key);
+        if ((it != affinities.end()) && (--it->second.second <= 0))
+            affinities.erase(it);
+    }
+}
+
+// Reads the first request of a client connection to choose the backend, passes it on
+// and then relays the bytes both ways, websocket frames are not looked at
+class router_session : public std::enable_shared_from_this<router_session>
+{
+    static constexpr std::size_t relay_buffer_size = 16384;
+
+    beast::basic_stream<stream_protocol> client_;
+    stream_protocol::socket backend_;
+    beast::flat_buffer buffer_;
+    http::request<http::string_body> req_;
+    http::response<http::string_body> res_;
+    std::string key_;
+    std::vector<int> candidates_;
+    std::size_t candidate_ = 0;
+    int routed_ = -1;       // backend index once connected
+    std::array<std::vector<char>, 2> buffers_;  // client to backend, backend to client
+
+public:
+    explicit router_session(stream_protocol::socket &&socket)
+        : client_(std::move(socket)), backend_(client_.get_executor())
+    {
+        for (auto &buffer : buffers_)
+            buffer.resize(relay_buffer_size);
+
+        beast::error_code ec;
+        client_.socket().set_option(tcp::no_delay(true), ec);
     }
 
-    ~session()
+    ~router_session()
     {
-        vosk_recognizer_free(rec_);
+        if (routed_ >= 0)
+            unroute(routed_, key_);
     }
 
-    // Get on the correct executor
     void
     run()
     {
-        // We need to be executing within a strand to perform async operations
-        // on the I/O objects in this session. Although not strictly necessary
-        // for single-threaded contexts, this example code is written to be
-        // thread-safe by default.
-        net::dispatch(ws_.get_executor(),
+        net::dispatch(client_.get_executor(),
                       beast::bind_front_handler(
-                          &session::on_run,
+                          &router_session::do_read,
                           shared_from_this()));
     }
 
-    // Start the asynchronous operation
+private:
     void
-    on_run()
+    do_read()
     {
-        // We output only text
-        ws_.text(true);
+        client_.expires_after(std::chrono::seconds(30));
 
-        // Set suggested timeout settings for the websocket
-        ws_.set_option(
-            websocket::stream_base::timeout::suggested(
-                beast::role_type::server));
-
-        // Set a decorator to change the Server of the handshake
-        ws_.set_option(websocket::stream_base::decorator(
-            [](websocket::response_type &res)
-            {
-                res.set(http::field::server,
-                        std::string(BOOST_BEAST_VERSION_STRING) +
-                            " websocket-server-async");
-            }));
-        // Accept the websocket handshake
-        ws_.async_accept(
+        http::async_read(
+            client_,
+            buffer_,
+            req_,
             beast::bind_front_handler(
-                &session::on_accept,
+                &router_session::on_read,
                 shared_from_this()));
     }
 
     void
-    on_accept(beast::error_code ec)
+    on_read(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
     {
+        boost::ignore_unused(bytes_transferred);
+
+        if (ec == http::error::end_of_stream)
+            return;
+
         if (ec)
-            return fail(ec, "accept");
+            return fail(ec, "read");
 
-        // Read a message
-        do_read();
+        key_ = affinity_key(req_.target());
+        candidates_ = rank_backends(key_);
+        do_connect();
     }
 
     void
-    do_read()
+    do_connect()
     {
-        // Read a message into our buffer
-        ws_.async_read(
-            buffer_,
+        // All backends are down or still starting
+        if (candidate_ >= candidates_.size())
+        {
+            res_.version(req_.version());
+            res_.keep_alive(false);
+            res_.result(http::status::service_unavailable);
+            res_.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+            res_.set(http::field::content_type, "text/plain");
+            res_.body() = "No backend available\n";
+            res_.prepare_payload();
+
+            http::async_write(
+                client_,
+                res_,
+                beast::bind_front_handler(
+                    &router_session::on_refused,
+                    shared_from_this()));
+            return;
+        }
+
+        backend_.async_connect(
+            local::endpoint(backends[candidates_[candidate_]].path),
             beast::bind_front_handler(
-                &session::on_read,
+                &router_session::on_connect,
                 shared_from_this()));
     }
 
-    Chunk process_chunk(const char *message, int len)
+    void
+    on_connect(beast::error_code ec)
     {
-        if (strcmp(message, "{\"eof\" : 1}") == 0)
-        {
-            return Chunk{vosk_recognizer_final_result(rec_), true};
-        }
-        // dirty hack, clients send their sampling rate this way, but
-        // this is not mapped to an API in Vosk, so filter it out here
-        else if ((len < 100) && (strstr(message, "sample_rate") != NULL))
-        {
-        	// careful, the buffer is sometimes not null-terminated!
-        	std::cout << message << "\n";
-        	return Chunk{vosk_recognizer_partial_result(rec_), false};
-        }
-        else if (vosk_recognizer_accept_waveform(rec_, message, len))
-        {
-            return Chunk{vosk_recognizer_result(rec_), false};
-        }
-        else
+        if (ec)
         {
-            return Chunk{vosk_recognizer_partial_result(rec_), false};
+            logError("Backend %s: %s\n", backends[candidates_[candidate_]].path.c_str(), ec.message().c_str());
+
+            beast::error_code ignored;
+            backend_.close(ignored);
+            candidate_++;
+            return do_connect();
         }
+
+        routed_ = candidates_[candidate_];
+        route(routed_, key_);
+
+        http::async_write(
+            backend_,
+            req_,
+            beast::bind_front_handler(
+                &router_session::on_forward,
+                shared_from_this()));
     }
 
     void
-    on_read(
+    on_forward(
         beast::error_code ec,
         std::size_t bytes_transferred)
     {
         boost::ignore_unused(bytes_transferred);
 
-        // This indicates that the session was closed
-        if (ec == websocket::error::closed)
-            return;
+        if (ec)
+            return fail(ec, "forward");
+
+        // Whatever the client sent after the request
+        net::async_write(
+            backend_,
+            buffer_.data(),
+            beast::bind_front_handler(
+                &router_session::on_relay_start,
+                shared_from_this()));
+    }
 
+    void
+    on_relay_start(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
         if (ec)
-            fail(ec, "read");
+            return fail(ec, "forward");
+
+        buffer_.consume(bytes_transferred);
+
+        // The backend sets the timeouts of the session
+        client_.expires_never();
+        do_relay_read(0);
+        do_relay_read(1);
+    }
 
-        if (chunk_.stop)
+    void
+    do_relay_read(int direction)
+    {
+        auto handler = beast::bind_front_handler(
+            &router_session::on_relay_read,
+            shared_from_this(),
+            direction);
+
+        if (direction == 0)
+            client_.async_read_some(net::buffer(buffers_[0]), std::move(handler));
+        else
+            backend_.async_read_some(net::buffer(buffers_[1]), std::move(handler));
+    }
+
+    void
+    on_relay_read(
+        int direction,
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        beast::error_code ignored;
+        stream_protocol::socket &to = (direction == 0) ? backend_ : client_.socket();
+
+        // The other direction goes on until its side closes as well
+        if (ec)
         {
-            ws_.close(beast::websocket::close_code::normal);
+            if (ec != net::error::eof)
+                return close();
 
+            to.shutdown(net::socket_base::shutdown_send, ignored);
             return;
         }
 
-        const char *buf = boost::asio::buffer_cast<const char *>(buffer_.cdata());
-        int len = static_cast<int>(buffer_.size());
-        chunk_ = process_chunk(buf, len);
-
-        ws_.async_write(
-            boost::asio::const_buffer(chunk_.result.data(), chunk_.result.size()),
+        net::async_write(
+            to,
+            net::buffer(buffers_[direction].data(), bytes_transferred),
             beast::bind_front_handler(
-                &session::on_write,
-                shared_from_this()));
+                &router_session::on_relay_write,
+                shared_from_this(),
+                direction));
     }
 
     void
-    on_write(
+    on_relay_write(
+        int direction,
         beast::error_code ec,
         std::size_t bytes_transferred)
     {
         boost::ignore_unused(bytes_transferred);
 
         if (ec)
-            return fail(ec, "write");
+            return close();
 
-        // Clear the buffer
-        buffer_.consume(buffer_.size());
+        do_relay_read(direction);
+    }
 
-        // Do another read
-        do_read();
+    void
+    on_refused(
+        beast::error_code ec,
+        std::size_t bytes_transferred)
+    {
+        boost::ignore_unused(ec, bytes_transferred);
+        close();
+    }
+
+    // Cancels whatever is still pending in the other direction
+    void
+    close()
+    {
+        beast::error_code ignored;
+        client_.socket().close(ignored);
+        backend_.close(ignored);
     }
 };
 
@@ -215,13 +1084,13 @@ public:
 class listener : public std::enable_shared_from_this<listener>
 {
     net::io_context &ioc_;
-    tcp::acceptor acceptor_;
+    net::basic_socket_acceptor<stream_protocol> acceptor_;
     Args args_;
 
 public:
     listener(
         net::io_context &ioc,
-        tcp::endpoint endpoint,
+        stream_protocol::endpoint endpoint,
         Args args)
         : ioc_(ioc), acceptor_(ioc), args_(args)
     {
@@ -243,6 +1112,18 @@ public:
             return;
         }
 
+        // The other server processes of the supervisor listen here as well,
+        // unless the router takes the connections and they listen on Unix sockets
+        if ((args_.server_processes > 1) && !args_.router)
+        {
+            acceptor_.set_option(reuse_port(true), ec);
+            if (ec)
+            {
+                fail(ec, "set_option");
+                return;
+            }
+        }
+
         // Bind to the server address
         acceptor_.bind(endpoint, ec);
         if (ec)
@@ -281,16 +1162,21 @@ private:
     }
 
     void
-    on_accept(beast::error_code ec, tcp::socket socket)
+    on_accept(beast::error_code ec, stream_protocol::socket socket)
     {
         if (ec)
         {
             fail(ec, "accept");
         }
+        else if (!backends.empty())
+        {
+            std::make_shared<router_session>(std::move(socket))->run();
+        }
         else
         {
-            // Create the session and run it
-            std::make_shared<session>(std::move(socket), std::move(args_))->run();
+            // Websocket or plain HTTP, the first request tells
+            Args args = args_;
+            std::make_shared<http_session>(std::move(socket), std::move(args))->run();
         }
 
         // Accept another connection
@@ -300,21 +1186,220 @@ private:
 
 //------------------------------------------------------------------------------
 
+// SIGHUP reloads the recognizers with the configuration as it is now, the sessions
+// move over at their next utterance boundary; that takes a while, so off the I/O threads.
+// main() blocks SIGHUP until the signal_set is there, so an early one waits for it.
+static std::thread reload_thread;
+static std::atomic<bool> reload_running{false};
+
+static void wait_for_reload(net::signal_set &signals, Args const &args)
+{
+    signals.async_wait(
+        [&signals, &args](beast::error_code ec, int)
+        {
+            if (ec)
+                return;
+
+            if (args.workers == 0)
+                logError("SIGHUP ignored, reloading needs recognizer workers (VOSK_RECOGNIZER_WORKERS).\n");
+            else if (reload_running.exchange(true))
+                logError("SIGHUP ignored, a reload is running already.\n");
+            else
+            {
+                // The previous one is done
+                if (reload_thread.joinable())
+                    reload_thread.join();
+
+                reload_thread = std::thread(
+                    [warmup_ms = args.warmup_ms, timeout_ms = args.startup_timeout_ms]
+                    {
+                        vosk_dlabpro_reload(warmup_ms, timeout_ms);
+                        reload_running = false;
+                    });
+            }
+
+            wait_for_reload(signals, args);
+        });
+}
+
+//------------------------------------------------------------------------------
+
+// Supervisor mode: forks the server processes and restarts those which die.
+// Returns the index of the process in the server processes, the supervisor
+// itself only returns when it is told to stop (-1).
+//
+// Each server process has its own recognizer workers and listens on the same
+// port (SO_REUSEPORT); they share the metrics, so any of them reports all.
+// In router mode the last process is the router and the others listen on
+// Unix sockets instead.
+static int supervise(int processes)
+{
+    sigset_t signals, previous;
+    std::vector<pid_t> pids(processes, 0);
+    bool stopping = false;
+
+    // Before forking, so the server processes count into the same metrics
+    metricsInit();
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &signals, &previous);
+
+    auto start = [&](int index) -> bool
+    {
+        std::cout.flush();
+        pid_t pid = fork();
+
+        if (pid == 0)
+        {
+            // The server processes do not outlive the supervisor
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            sigprocmask(SIG_SETMASK, &previous, nullptr);
+            metricsSetProcess(index, processes);
+            return true;
+        }
+        if (pid < 0)
+            logError("Cannot fork server process %d: %s\n", index, strerror(errno));
+        else
+            logInfo("Started server process %d, pid %d.\n", index, static_cast<int>(pid));
+
+        pids[index] = pid;
+        return false;
+    };
+
+    for (int index = 0; index < processes; ++index)
+        if (start(index))
+            return index;
+
+    for (;;)
+    {
+        int signal = sigwaitinfo(&signals, nullptr);
+
+        if ((signal == SIGHUP) || (signal == SIGINT) || (signal == SIGTERM))
+        {
+            // A reload is done by every server process on its own
+            stopping = stopping || (signal != SIGHUP);
+            for (pid_t pid : pids)
+                if (pid > 0)
+                    kill(pid, (signal == SIGHUP) ? SIGHUP : SIGTERM);
+        }
+
+        if (signal != SIGCHLD)
+            continue;
+
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            auto it = std::find(pids.begin(), pids.end(), pid);
+            if (it == pids.end())
+                continue;
+
+            int index = static_cast<int>(it - pids.begin());
+            *it = 0;
+
+            // Its sessions are gone with it
+            metricsClearProcess(index);
+
+            if (stopping)
+                continue;
+
+            if (WIFSIGNALED(status))
+                logError("Server process %d (pid %d) killed by signal %d, restarting it.\n", index, static_cast<int>(pid), WTERMSIG(status));
+            else
+                logError("Server process %d (pid %d) exited with %d, restarting it.\n", index, static_cast<int>(pid), WEXITSTATUS(status));
+
+            // Do not spin if it dies right away
+            sleep(1);
+            if (start(index))
+                return index;
+        }
+
+        if (stopping && (std::count(pids.begin(), pids.end(), 0) == processes))
+            return -1;
+    }
+}
+
+//------------------------------------------------------------------------------
+
+// The router process, it loads no models and only relays the connections to the backends
+static int run_router(tcp::endpoint endpoint, int threads, Args const &args)
+{
+    // A reload is for the backends
+    signal(SIGHUP, SIG_IGN);
+
+    logInfo("Routing to %d server processes.\n", static_cast<int>(backends.size()));
+
+    net::io_context ioc{threads};
+
+    std::make_shared<listener>(ioc, endpoint, args)->run();
+
+    std::vector<std::thread> v;
+    v.reserve(threads - 1);
+    for (auto i = threads - 1; i > 0; --i)
+        v.emplace_back(
+            [&ioc]
+            {
+                ioc.run();
+            });
+    ioc.run();
+
+    return EXIT_SUCCESS;
+}
+
+//------------------------------------------------------------------------------
+
 int main(int argc, char *argv[])
 {
     // Check command line arguments.
     if (argc != 5)
     {
-        std::cerr << "Usage: asr_server <address> <port> <threads> <model-path>\n"
+        std::cerr << "Usage: asr_server <address> <port> <threads> <model-path>[,<name>=<model-path>...]\n"
                   << "Example:\n"
-                  << "    asr_server 0.0.0.0 8080 1 model_path\n";
+                  << "    asr_server 0.0.0.0 8080 1 model_path\n"
+                  << "    asr_server 0.0.0.0 8080 1 de=models/de,en=models/en\n"
+                  << "A model path is a directory with recognizer.cfg or the configuration file,\n"
+                  << "clients choose a named model by the URL path (ws://host:8080/en),\n"
+                  << "the first model serves the rest.\n";
         return EXIT_FAILURE;
     }
+
+    // Until the server process installs its handler, SIGHUP (reload) must not kill
+    // it while it loads the models; the supervisor and every thread and process
+    // started from here inherit the mask, the server process unblocks it later.
+    sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    sigprocmask(SIG_BLOCK, &hangup, nullptr);
     auto const address = net::ip::make_address(argv[1]);
     auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
     auto const threads = std::max<int>(1, std::atoi(argv[3]));
-    auto const model_path = argv[4];
-    model = vosk_model_new(model_path);
+    // name=path,name=path or just a path
+    std::vector<std::pair<std::string, std::string>> model_paths;
+    std::string model_list = argv[4];
+    for (std::size_t start = 0; start <= model_list.size();)
+    {
+        std::size_t end = std::min(model_list.find(',', start), model_list.size());
+        std::string entry = model_list.substr(start, end - start);
+        std::size_t equals = entry.find('=');
+
+        if (!entry.empty())
+        {
+            if (equals == std::string::npos)
+                model_paths.emplace_back("", entry);
+            else
+                model_paths.emplace_back(entry.substr(0, equals), entry.substr(equals + 1));
+        }
+        start = end + 1;
+    }
+    if (model_paths.empty())
+    {
+        std::cerr << "No model path given\n";
+        return EXIT_FAILURE;
+    }
 
     Args args;
     if (const char *env_p = std::getenv("VOSK_SAMPLE_RATE"))
@@ -329,11 +1414,163 @@ int main(int argc, char *argv[])
     {
         args.show_words = strcmp(env_p, "True") == 0;
     }
+    if (const char *env_p = std::getenv("VOSK_RECOGNIZER_WORKERS"))
+    {
+        args.workers = std::max<int>(0, std::stoi(env_p));
+    }
+    if (const char *env_p = std::getenv("VOSK_DECODE_THREADS"))
+    {
+        args.decode_threads = std::stoi(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_LOG_LEVEL"))
+    {
+        vosk_set_log_level(std::stoi(env_p));
+    }
+    if (const char *env_p = std::getenv("VOSK_VAD_FILTER"))
+    {
+        args.vad_filter = strcmp(env_p, "0") != 0 && strcmp(env_p, "False") != 0;
+    }
+    if (const char *env_p = std::getenv("VOSK_VAD_THRESHOLD_DB"))
+    {
+        args.vad_threshold_db = std::stof(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_VAD_HANGOVER_MS"))
+    {
+        args.vad_hangover_ms = std::stoi(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_VAD_PREROLL_MS"))
+    {
+        args.vad_preroll_ms = std::stoi(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_SCHEDULER_POLICY"))
+    {
+        args.scheduler_policy = strcmp(env_p, "speech") == 0 ? VOSK_DLABPRO_SCHEDULE_SPEECH : VOSK_DLABPRO_SCHEDULE_FIFO;
+    }
+    if (const char *env_p = std::getenv("VOSK_SESSION_QUEUE_MS"))
+    {
+        args.session_queue_ms = std::stoi(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_PARTIAL_CHANGES_ONLY"))
+    {
+        args.partial_changes_only = strcmp(env_p, "0") != 0 && strcmp(env_p, "False") != 0;
+    }
+    if (const char *env_p = std::getenv("VOSK_PARTIAL_INTERVAL_MS"))
+    {
+        args.partial_interval_ms = std::stoi(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_WARMUP_MS"))
+    {
+        args.warmup_ms = std::stoi(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_STARTUP_TIMEOUT_MS"))
+    {
+        args.startup_timeout_ms = std::stoi(env_p);
+    }
+    if (const char *env_p = std::getenv("VOSK_SERVER_PROCESSES"))
+    {
+        args.server_processes = std::min<int>(METRICS_MAX_PROCESSES, std::max<int>(1, std::stoi(env_p)));
+    }
+    if (const char *env_p = std::getenv("VOSK_ROUTER"))
+    {
+        args.router = strcmp(env_p, "0") != 0 && strcmp(env_p, "False") != 0;
+    }
+    if (const char *env_p = std::getenv("VOSK_ROUTER_SOCKET_DIR"))
+    {
+        args.socket_dir = env_p;
+    }
+
+    // The router is one more process of the supervisor
+    if (args.router)
+    {
+        args.server_processes = std::min<int>(METRICS_MAX_PROCESSES - 1, args.server_processes);
+    }
+    auto socket_path = [&](int index)
+    {
+        return args.socket_dir + "/asr_server." + std::to_string(port) + "." + std::to_string(index) + ".sock";
+    };
+
+    // Everything below runs in each of the server processes
+    int process = 0;
+    if ((args.server_processes > 1) || args.router)
+    {
+        process = supervise(args.server_processes + (args.router ? 1 : 0));
+        if (process < 0)
+            return EXIT_SUCCESS;
+    }
+
+    if (args.router && (process == args.server_processes))
+    {
+        for (int index = 0; index < args.server_processes; ++index)
+            backends.push_back({socket_path(index), index});
+        return run_router(tcp::endpoint{address, port}, threads, args);
+    }
+
+    // Only one recognizer fits into this process, further models need workers
+    if ((model_paths.size() > 1) && (args.workers == 0))
+    {
+        logInfo("Several models, running them in one recognizer worker each.\n");
+        args.workers = 1;
+    }
+
+    // Workers are forked from here, so do this before any thread is started
+    vosk_dlabpro_set_workers(args.workers);
+    vosk_dlabpro_set_scheduler(args.scheduler_policy, args.session_queue_ms);
+    vosk_dlabpro_set_voice_filter(args.vad_filter, args.vad_threshold_db, args.vad_hangover_ms, args.vad_preroll_ms);
+    vosk_dlabpro_set_partial_interval(args.partial_interval_ms);
+    for (auto const &entry : model_paths)
+    {
+        VoskModel *model = vosk_model_new(entry.second.c_str());
+
+        if (!model)
+        {
+            std::cerr << "Cannot load model " << entry.second << "\n";
+            return EXIT_FAILURE;
+        }
+        logInfo("Model \"%s\" from %s.\n", entry.first.c_str(), entry.second.c_str());
+        models.emplace_back(entry.first, model);
+    }
+
+    // Nobody connects before the recognizers are online and warm
+    if (!vosk_dlabpro_warm_up(args.warmup_ms, args.startup_timeout_ms))
+    {
+        std::cerr << "Recognizers not ready within " << args.startup_timeout_ms << " ms\n";
+        return EXIT_FAILURE;
+    }
+
+    // Recognizer work gets its own threads, <threads> only sizes the network side.
+    // By default one thread for each session holding a recognizer, its calls wait
+    // for the recognizer, and one per core for the sessions queueing meanwhile,
+    // whose calls only resample and queue; none of the calls waits for a worker.
+    if (args.decode_threads <= 0)
+    {
+        int recognizers = std::max<int>(1, args.workers) * static_cast<int>(models.size());
+        args.decode_threads = recognizers + static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    net::thread_pool decode_pool(args.decode_threads);
+    decoder = &decode_pool;
+
     // The io_context is required for all I/O
     net::io_context ioc{threads};
 
-    // Create and launch a listening port
-    std::make_shared<listener>(ioc, tcp::endpoint{address, port}, args)->run();
+    // Create and launch a listening port, behind the router a Unix socket
+    if (args.router)
+    {
+        std::string path = socket_path(process);
+
+        // Left over from the process this one replaces
+        unlink(path.c_str());
+        std::make_shared<listener>(ioc, local::endpoint{path}, args)->run();
+    }
+    else
+    {
+        std::make_shared<listener>(ioc, tcp::endpoint{address, port}, args)->run();
+    }
+
+    net::signal_set signals(ioc, SIGHUP);
+    wait_for_reload(signals, args);
+
+    // Blocked since the start of main(), the I/O threads take it from here on
+    pthread_sigmask(SIG_UNBLOCK, &hangup, nullptr);
 
     // Run the I/O service on the requested number of threads
     std::vector<std::thread> v;
@@ -346,6 +1583,11 @@ int main(int argc, char *argv[])
             });
     ioc.run();
 
-    vosk_model_free(model);
+    if (reload_thread.joinable())
+        reload_thread.join();
+    decode_pool.join();
+
+    for (auto const &entry : models)
+        vosk_model_free(entry.second);
     return EXIT_SUCCESS;
 }
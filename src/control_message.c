@@ -0,0 +1,332 @@
+
+#include "control_message.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// deeper nesting is not part of any control message
+#define CONTROL_MAX_DEPTH 8
+#define CONTROL_KEY_SIZE  32
+
+typedef struct Parser
+{
+	const char *next;
+	const char *end;
+} Parser;
+
+//////////////////////////////////////////////
+//
+// JSON scanning, only as much as the control messages need
+//
+//////////////////////////////////////////////
+static void skipSpace(Parser *parser)
+{
+	while ((parser->next < parser->end) && (strchr(" \t\r\n", *parser->next) != NULL) && (*parser->next != 0))
+	{
+		parser->next++;
+	}
+}
+
+static int consume(Parser *parser, char c)
+{
+	skipSpace(parser);
+	
+	if ((parser->next < parser->end) && (*parser->next == c))
+	{
+		parser->next++;
+		return 1;
+	}
+	
+	return 0;
+}
+
+// copies the string (escapes as they are, keys have none), longer ones are truncated
+static int parseString(Parser *parser, char *text, int size)
+{
+	int length = 0;
+	
+	if (consume(parser, '"') == 0)
+	{
+		return 0;
+	}
+	
+	while (parser->next < parser->end)
+	{
+		char c = *parser->next++;
+		
+		if (c == '"')
+		{
+			if (size > 0)
+			{
+				text[length] = 0;
+			}
+			
+			return 1;
+		}
+		
+		if ((c == '\\') && (parser->next < parser->end))
+		{
+			parser->next++;
+		}
+		
+		if (length + 1 < size)
+		{
+			text[length++] = c;
+		}
+	}
+	
+	return 0;
+}
+
+// numbers, and true/false as 1/0
+static int parseNumber(Parser *parser, double *value)
+{
+	char number[CONTROL_KEY_SIZE];
+	char *stop;
+	int length = 0;
+	
+	skipSpace(parser);
+	
+	if ((parser->end - parser->next >= 4) && (strncmp(parser->next, "true", 4) == 0))
+	{
+		parser->next += 4;
+		*value = 1.0;
+		return 1;
+	}
+	
+	if ((parser->end - parser->next >= 5) && (strncmp(parser->next, "false", 5) == 0))
+	{
+		parser->next += 5;
+		*value = 0.0;
+		return 1;
+	}
+	
+	// the message is not 0-terminated
+	while ((parser->next + length < parser->end) && (length + 1 < CONTROL_KEY_SIZE) &&
+		(strchr("+-.0123456789eE", parser->next[length]) != NULL) && (parser->next[length] != 0))
+	{
+		number[length] = parser->next[length];
+		length++;
+	}
+	
+	number[length] = 0;
+	*value = strtod(number, &stop);
+	
+	if ((length == 0) || (*stop != 0))
+	{
+		return 0;
+	}
+	
+	parser->next += length;
+	return 1;
+}
+
+static int skipValue(Parser *parser, int depth)
+{
+	double number;
+	
+	if (depth > CONTROL_MAX_DEPTH)
+	{
+		return 0;
+	}
+	
+	skipSpace(parser);
+	
+	if (parser->next >= parser->end)
+	{
+		return 0;
+	}
+	
+	if (*parser->next == '"')
+	{
+		return parseString(parser, NULL, 0);
+	}
+	
+	if ((*parser->next == '{') || (*parser->next == '['))
+	{
+		char close = (*parser->next == '{') ? '}' : ']';
+		
+		parser->next++;
+		
+		if (consume(parser, close) != 0)
+		{
+			return 1;
+		}
+		
+		do
+		{
+			if ((close == '}') && ((parseString(parser, NULL, 0) == 0) || (consume(parser, ':') == 0)))
+			{
+				return 0;
+			}
+			
+			if (skipValue(parser, depth + 1) == 0)
+			{
+				return 0;
+			}
+		}
+		while (consume(parser, ',') != 0);
+		
+		return consume(parser, close);
+	}
+	
+	if ((parser->end - parser->next >= 4) && (strncmp(parser->next, "null", 4) == 0))
+	{
+		parser->next += 4;
+		return 1;
+	}
+	
+	return parseNumber(parser, &number);
+}
+
+// the value of a command, only true or a number other than 0 sets it (null is a value as well)
+static int parseSwitch(Parser *parser, int *set)
+{
+	double value = 0.0;
+	
+	skipSpace(parser);
+	
+	if ((parser->end - parser->next >= 4) && (strncmp(parser->next, "null", 4) == 0))
+	{
+		parser->next += 4;
+	}
+	else if (parseNumber(parser, &value) == 0)
+	{
+		return 0;
+	}
+	
+	*set = (value != 0.0);
+	return 1;
+}
+
+//////////////////////////////////////////////
+static int parseConfig(Parser *parser, ControlMessage *message)
+{
+	char key[CONTROL_KEY_SIZE];
+	double value;
+	
+	if (consume(parser, '{') == 0)
+	{
+		return 0;
+	}
+	
+	if (consume(parser, '}') != 0)
+	{
+		return 1;
+	}
+	
+	do
+	{
+		if ((parseString(parser, key, sizeof(key)) == 0) || (consume(parser, ':') == 0))
+		{
+			return 0;
+		}
+		
+		if (strcmp(key, "sample_rate") == 0)
+		{
+			if ((parseNumber(parser, &value) == 0) || (value <= 0.0))
+			{
+				return 0;
+			}
+			
+			message->sampleRate = (float) value;
+		}
+		else if ((strcmp(key, "max_alternatives") == 0) || (strcmp(key, "words") == 0))
+		{
+			if ((parseNumber(parser, &value) == 0) || (value < 0.0))
+			{
+				return 0;
+			}
+			
+			*((key[0] == 'w') ? &message->words : &message->maxAlternatives) = (int) value;
+		}
+		else if (skipValue(parser, 1) == 0)
+		{
+			return 0;
+		}
+	}
+	while (consume(parser, ',') != 0);
+	
+	return consume(parser, '}');
+}
+
+//////////////////////////////////////////////
+int controlMessageParse(const char *text, int length, ControlMessage *message)
+{
+	Parser parser = { text, text + length };
+	char key[CONTROL_KEY_SIZE];
+	
+	message->type            = CONTROL_INVALID;
+	message->sampleRate      = -1.0f;
+	message->maxAlternatives = -1;
+	message->words           = -1;
+	
+	if (consume(&parser, '{') == 0)
+	{
+		return 0;
+	}
+	
+	// the first known command counts, other members are ignored
+	do
+	{
+		if ((parseString(&parser, key, sizeof(key)) == 0) || (consume(&parser, ':') == 0))
+		{
+			message->type = CONTROL_INVALID;
+			return 0;
+		}
+		
+		if ((message->type == CONTROL_INVALID) && (strcmp(key, "config") == 0))
+		{
+			message->type = CONTROL_CONFIG;
+			
+			if (parseConfig(&parser, message) == 0)
+			{
+				message->type = CONTROL_INVALID;
+				return 0;
+			}
+			
+			continue;
+		}
+		
+		if ((message->type == CONTROL_INVALID) &&
+			((strcmp(key, "eof") == 0) || (strcmp(key, "reset") == 0) || (strcmp(key, "stats") == 0)))
+		{
+			int set;
+			
+			// {"eof" : 0} does not end the session
+			if (parseSwitch(&parser, &set) == 0)
+			{
+				return 0;
+			}
+			
+			if (set != 0)
+			{
+				message->type = (key[0] == 'e') ? CONTROL_EOF : (key[0] == 'r') ? CONTROL_RESET : CONTROL_STATS;
+			}
+			
+			continue;
+		}
+		
+		if (skipValue(&parser, 1) == 0)
+		{
+			message->type = CONTROL_INVALID;
+			return 0;
+		}
+	}
+	while (consume(&parser, ',') != 0);
+	
+	if (consume(&parser, '}') == 0)
+	{
+		message->type = CONTROL_INVALID;
+	}
+	
+	// nothing may follow
+	skipSpace(&parser);
+	
+	if (parser.next != parser.end)
+	{
+		message->type = CONTROL_INVALID;
+	}
+	
+	return message->type != CONTROL_INVALID;
+}
@@ -0,0 +1,36 @@
+/* Parser for the text messages of a websocket session, the control channel next to the binary audio */
+
+#ifndef CONTROL_MESSAGE_H
+#define CONTROL_MESSAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum ControlType
+{
+	CONTROL_INVALID,    // not JSON, or no known command
+	CONTROL_CONFIG,     // {"config" : {"sample_rate" : 16000, "max_alternatives" : 0, "words" : true}}
+	CONTROL_EOF,        // {"eof" : 1}, the end of the stream (1, true or any other number but 0)
+	CONTROL_RESET,      // {"reset" : 1}, drop the current utterance
+	CONTROL_STATS       // {"stats" : 1}, the statistics of the session
+} ControlType;
+
+typedef struct ControlMessage
+{
+	ControlType type;
+	
+	// settings of a config message, -1 if not given (unknown ones are ignored)
+	float sampleRate;
+	int   maxAlternatives;
+	int   words;
+} ControlMessage;
+
+// the message does not need to be 0-terminated, returns 0 if it is not a valid control message
+int controlMessageParse(const char *text, int length, ControlMessage *message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONTROL_MESSAGE_H */
@@ -0,0 +1,156 @@
+
+#include "json_buffer.h"
+
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////
+void jsonBufferInit(JsonBuffer *buffer)
+{
+	buffer->data     = NULL;
+	buffer->length   = 0;
+	buffer->capacity = 0;
+	buffer->failed   = 0;
+}
+
+//////////////////////////////////////////////
+void jsonBufferFree(JsonBuffer *buffer)
+{
+	free(buffer->data);
+	jsonBufferInit(buffer);
+}
+
+//////////////////////////////////////////////
+void jsonBufferClear(JsonBuffer *buffer)
+{
+	buffer->length = 0;
+	buffer->failed = 0;
+	
+	if (buffer->data != NULL)
+	{
+		buffer->data[0] = 0;
+	}
+}
+
+//////////////////////////////////////////////
+//
+// make room for additional bytes plus the terminating 0,
+// doubling the capacity keeps appending linear
+//
+// returns 0 if there is no room, the buffer is marked as failed then
+//
+//////////////////////////////////////////////
+static int jsonBufferReserve(JsonBuffer *buffer, int additional)
+{
+	int required = buffer->length + additional + 1;
+	
+	if (buffer->failed != 0)
+	{
+		return 0;
+	}
+	
+	if (required > buffer->capacity)
+	{
+		int capacity = (buffer->capacity > 0) ? buffer->capacity : 256;
+		char *grown;
+		
+		while (capacity < required)
+		{
+			capacity *= 2;
+		}
+		
+		grown = (char*) realloc(buffer->data, capacity);
+		
+		if (grown == NULL)
+		{
+			// keep the old contents, the caller must not hand out the truncated string
+			logError("Out of memory for JSON buffer (%d bytes)!\n", capacity);
+			buffer->failed = 1;
+			return 0;
+		}
+		
+		buffer->data     = grown;
+		buffer->capacity = capacity;
+	}
+	
+	return 1;
+}
+
+//////////////////////////////////////////////
+void jsonBufferAppend(JsonBuffer *buffer, const char *text)
+{
+	int length = strlen(text);
+	
+	if (jsonBufferReserve(buffer, length) == 0)
+	{
+		return;
+	}
+	
+	memcpy(buffer->data + buffer->length, text, length + 1);
+	buffer->length += length;
+}
+
+//////////////////////////////////////////////
+void jsonBufferAppendEscaped(JsonBuffer *buffer, const char *text)
+{
+	static const char hexDigits[] = "0123456789abcdef";
+	int worstCase = strlen(text) * 6;
+	const unsigned char *src;
+	char *dst;
+	
+	// worst case is \u00XX for every byte, reserving that once avoids checks in the loop
+	if (jsonBufferReserve(buffer, worstCase) == 0)
+	{
+		return;
+	}
+	
+	dst = buffer->data + buffer->length;
+	
+	for (src = (const unsigned char*) text; *src != 0; src++)
+	{
+		switch (*src)
+		{
+			case '"':  *dst++ = '\\'; *dst++ = '"';  break;
+			case '\\': *dst++ = '\\'; *dst++ = '\\'; break;
+			case '\b': *dst++ = '\\'; *dst++ = 'b';  break;
+			case '\f': *dst++ = '\\'; *dst++ = 'f';  break;
+			case '\n': *dst++ = '\\'; *dst++ = 'n';  break;
+			case '\r': *dst++ = '\\'; *dst++ = 'r';  break;
+			case '\t': *dst++ = '\\'; *dst++ = 't';  break;
+			
+			default:
+				if (*src < 0x20)
+				{
+					*dst++ = '\\';
+					*dst++ = 'u';
+					*dst++ = '0';
+					*dst++ = '0';
+					*dst++ = hexDigits[*src >> 4];
+					*dst++ = hexDigits[*src & 0x0F];
+				}
+				else
+				{
+					// UTF-8 sequences pass unchanged
+					*dst++ = (char) *src;
+				}
+				break;
+		}
+	}
+	
+	*dst = 0;
+	buffer->length = dst - buffer->data;
+}
+
+//////////////////////////////////////////////
+const char *jsonBufferText(const JsonBuffer *buffer)
+{
+	return (buffer->data != NULL) ? buffer->data : "";
+}
+
+//////////////////////////////////////////////
+int jsonBufferFailed(const JsonBuffer *buffer)
+{
+	return buffer->failed;
+}
@@ -0,0 +1,31 @@
+/* Growable output buffer for building JSON strings in one pass */
+
+#ifndef JSON_BUFFER_H
+#define JSON_BUFFER_H
+
+typedef struct JsonBuffer
+{
+	char *data;        // always 0-terminated once something was written
+	int   length;
+	int   capacity;
+	int   failed;      // out of memory since the last clear, nothing is appended anymore
+} JsonBuffer;
+
+void jsonBufferInit(JsonBuffer *buffer);
+void jsonBufferFree(JsonBuffer *buffer);
+
+// forget the contents (and a failure), but keep the memory for the next string
+void jsonBufferClear(JsonBuffer *buffer);
+
+// append verbatim, e.g. the JSON syntax around the values
+void jsonBufferAppend(JsonBuffer *buffer, const char *text);
+
+// append the contents of a JSON string value, escaping quotes, backslashes and control characters
+void jsonBufferAppendEscaped(JsonBuffer *buffer, const char *text);
+
+const char *jsonBufferText(const JsonBuffer *buffer);
+
+// 1 if an append since the last clear ran out of memory, the text is incomplete then
+int jsonBufferFailed(const JsonBuffer *buffer);
+
+#endif /* JSON_BUFFER_H */
@@ -0,0 +1,255 @@
+
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+
+//////////////////////////////////////////////
+//
+// bounded multi producer queue of formatted messages
+//
+//////////////////////////////////////////////
+
+// power of 2
+#define LOG_QUEUE_SLOTS    1024
+
+// longer messages are truncated
+#define LOG_MESSAGE_SIZE   512
+
+// the writer checks the queue this often, producers never wake it up
+#define LOG_WRITER_POLL_MS 5
+
+typedef struct LogSlot
+{
+	// equals the queue position when the slot is free for it,
+	// and the position + 1 once the message for it is complete
+	unsigned int sequence;
+	char text[LOG_MESSAGE_SIZE];
+} LogSlot;
+
+int logCurrentLevel = LOG_LEVEL_INFO;
+
+static LogSlot        logQueue[LOG_QUEUE_SLOTS];
+static unsigned int   logHead = 0;       // next position for a producer
+static unsigned int   logTail = 0;       // next position for the writer
+static unsigned int   logDropped = 0;    // messages lost since the queue was full
+static pthread_once_t logQueueOnce = PTHREAD_ONCE_INIT;
+
+static pthread_t logWriterThreadId;
+static int       logWriterRunning = 0;
+static int       logWriterExit = 0;
+static int       logHandlersRegistered = 0;
+
+//////////////////////////////////////////////
+static void initQueue(void)
+{
+	unsigned int i;
+	
+	for (i = 0; i < LOG_QUEUE_SLOTS; i++)
+	{
+		logQueue[i].sequence = i;
+	}
+	
+	logHead = 0;
+	logTail = 0;
+}
+
+//////////////////////////////////////////////
+//
+// writer side, there is exactly one writer thread per process
+//
+//////////////////////////////////////////////
+static int writeNext(void)
+{
+	LogSlot *slot = &logQueue[logTail & (LOG_QUEUE_SLOTS - 1)];
+	
+	if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != logTail + 1)
+	{
+		return 0;
+	}
+	
+	fputs(slot->text, stdout);
+	
+	// free for the position one round later
+	__atomic_store_n(&slot->sequence, logTail + LOG_QUEUE_SLOTS, __ATOMIC_RELEASE);
+	__atomic_store_n(&logTail, logTail + 1, __ATOMIC_RELEASE);
+	
+	return 1;
+}
+
+static void* logWriter(void* arg)
+{
+	for (;;)
+	{
+		unsigned int dropped;
+		int written = 0;
+		
+		while (writeNext() != 0)
+		{
+			written++;
+		}
+		
+		dropped = __atomic_exchange_n(&logDropped, 0, __ATOMIC_RELAXED);
+		
+		if (dropped != 0)
+		{
+			printf("(%u log messages dropped)\n", dropped);
+			written++;
+		}
+		
+		if (written != 0)
+		{
+			fflush(stdout);
+		}
+		else if (__atomic_load_n(&logWriterExit, __ATOMIC_ACQUIRE) != 0)
+		{
+			break;
+		}
+		else
+		{
+			usleep(LOG_WRITER_POLL_MS * 1000);
+		}
+	}
+	
+	return (void *) NULL;
+}
+
+//////////////////////////////////////////////
+//
+// the writer thread does not survive fork(), so the parent writes out
+// what is queued before, and the child starts its own writer on demand
+//
+//////////////////////////////////////////////
+static void stopWriter(void)
+{
+	if (__atomic_load_n(&logWriterRunning, __ATOMIC_ACQUIRE) != 0)
+	{
+		__atomic_store_n(&logWriterExit, 1, __ATOMIC_RELEASE);
+		pthread_join(logWriterThreadId, NULL);
+		__atomic_store_n(&logWriterRunning, 0, __ATOMIC_RELEASE);
+		__atomic_store_n(&logWriterExit, 0, __ATOMIC_RELEASE);
+	}
+}
+
+static void forkChild(void)
+{
+	logWriterRunning = 0;
+	logWriterExit = 0;
+	initQueue();
+}
+
+static void startWriter(void)
+{
+	int expected = 0;
+	
+	if (__atomic_compare_exchange_n(&logWriterRunning, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == 0)
+	{
+		return;
+	}
+	
+	if (pthread_create(&logWriterThreadId, NULL, logWriter, NULL) != 0)
+	{
+		// nobody would ever empty the queue, so only errors are logged from now on
+		__atomic_store_n(&logWriterRunning, 0, __ATOMIC_RELEASE);
+		__atomic_store_n(&logCurrentLevel, LOG_LEVEL_ERROR, __ATOMIC_RELAXED);
+		fprintf(stderr, "Cannot start the log writer, only errors are logged!\n");
+		return;
+	}
+	
+	if (logHandlersRegistered == 0)
+	{
+		logHandlersRegistered = 1;
+		pthread_atfork(logFlush, NULL, forkChild);
+		atexit(stopWriter);
+	}
+}
+
+//////////////////////////////////////////////
+void logSetLevel(int level)
+{
+	__atomic_store_n(&logCurrentLevel, level, __ATOMIC_RELAXED);
+}
+
+//////////////////////////////////////////////
+void logWrite(const char *format, ...)
+{
+	unsigned int position;
+	LogSlot *slot;
+	va_list args;
+	
+	pthread_once(&logQueueOnce, initQueue);
+	
+	if (__atomic_load_n(&logWriterRunning, __ATOMIC_ACQUIRE) == 0)
+	{
+		startWriter();
+	}
+	
+	// claim a position, the slot for it must have been written out already
+	position = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+	
+	for (;;)
+	{
+		int difference;
+		
+		slot = &logQueue[position & (LOG_QUEUE_SLOTS - 1)];
+		difference = (int) (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - position);
+		
+		if (difference == 0)
+		{
+			if (__atomic_compare_exchange_n(&logHead, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) != 0)
+			{
+				break;
+			}
+		}
+		else if (difference < 0)
+		{
+			// full, logging must never block the caller
+			__atomic_fetch_add(&logDropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		else
+		{
+			position = __atomic_load_n(&logHead, __ATOMIC_RELAXED);
+		}
+	}
+	
+	va_start(args, format);
+	vsnprintf(slot->text, LOG_MESSAGE_SIZE, format, args);
+	va_end(args);
+	
+	__atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+//////////////////////////////////////////////
+//
+// errors are rare and must not get lost, so they skip the queue
+//
+//////////////////////////////////////////////
+void logWriteError(const char *format, ...)
+{
+	char text[LOG_MESSAGE_SIZE];
+	va_list args;
+	
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	
+	// in one piece, stderr is locked for the call and not buffered
+	fputs(text, stderr);
+}
+
+//////////////////////////////////////////////
+void logFlush(void)
+{
+	unsigned int head = __atomic_load_n(&logHead, __ATOMIC_ACQUIRE);
+	
+	while ((__atomic_load_n(&logWriterRunning, __ATOMIC_ACQUIRE) != 0) && ((int) (__atomic_load_n(&logTail, __ATOMIC_ACQUIRE) - head) < 0))
+	{
+		usleep(1000);
+	}
+	
+	fflush(stdout);
+}
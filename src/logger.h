@@ -0,0 +1,46 @@
+/* Leveled logging: info and debug through a lock-free queue, written to stdout by a background thread,
+   errors straight to stderr */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// same meaning as the level of vosk_set_log_level()
+#define LOG_LEVEL_ERROR  -1
+#define LOG_LEVEL_INFO    0
+#define LOG_LEVEL_DEBUG   1
+
+// messages above this level are not even compiled in, e.g. -DLOG_MAX_LEVEL=0 for production builds
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// messages above this level are dropped at runtime, before any formatting happens
+extern int logCurrentLevel;
+
+#define LOG_ENABLED(level) (((level) <= LOG_MAX_LEVEL) && ((level) <= __atomic_load_n(&logCurrentLevel, __ATOMIC_RELAXED)))
+
+#define logError(...) do { if (LOG_ENABLED(LOG_LEVEL_ERROR)) logWriteError(__VA_ARGS__); } while (0)
+#define logInfo(...)  do { if (LOG_ENABLED(LOG_LEVEL_INFO))  logWrite(__VA_ARGS__); } while (0)
+#define logDebug(...) do { if (LOG_ENABLED(LOG_LEVEL_DEBUG)) logWrite(__VA_ARGS__); } while (0)
+
+void logSetLevel(int level);
+
+// formats into the queue and returns, the message is dropped if the queue is full
+// (use the macros above, they skip the call if the level is off)
+void logWrite(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+// writes to stderr right away, errors are never dropped and stay apart from the other output
+void logWriteError(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+
+// blocks until everything queued so far is written, e.g. before _exit()
+void logFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_H */
@@ -0,0 +1,292 @@
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+//////////////////////////////////////////////
+//
+// all values are only ever changed with atomic operations,
+// so any thread of any process sharing the memory may update them
+//
+//////////////////////////////////////////////
+
+// upper bounds in seconds, one more bucket catches the rest
+static const double histogramBounds[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0 };
+
+#define HISTOGRAM_BUCKETS (sizeof(histogramBounds) / sizeof(double) + 1)
+
+// backlogs of more workers are not reported
+#define METRICS_MAX_WORKERS 64
+
+typedef struct Histogram
+{
+	unsigned long long buckets[HISTOGRAM_BUCKETS];    // not cumulative, that is done while rendering
+	unsigned long long sumMicroseconds;
+} Histogram;
+
+typedef struct Metrics
+{
+	long long counters[METRIC_COUNTERS];
+	Histogram histograms[METRIC_HISTOGRAMS];
+	
+	// per server process, they describe the current state of the process
+	long long gauges[METRICS_MAX_PROCESSES][METRIC_GAUGES];
+	int       backlogs[METRICS_MAX_PROCESSES][METRICS_MAX_WORKERS];
+	int       processes;    // the backlogs are labeled with the process if there are several
+} Metrics;
+
+static Metrics  localMetrics;
+static Metrics *metrics = &localMetrics;
+
+// slot of this server process, see metricsSetProcess()
+static int metricsProcess = 0;
+
+//////////////////////////////////////////////
+//
+// names and descriptions, in the order of the enums
+//
+//////////////////////////////////////////////
+static const char *counterNames[METRIC_COUNTERS][2] =
+{
+	{ "vosk_chunks_total",                  "Audio chunks received" },
+	{ "vosk_chunks_queued_total",           "Audio chunks queued as no recognizer was free for the session" },
+	{ "vosk_chunks_ignored_total",          "Audio chunks dropped as the recognizer worker was gone" },
+	{ "vosk_audio_seconds_total",           "Seconds of audio decoded" },
+	{ "vosk_decode_seconds_total",          "Seconds the recognizers spent decoding, divided by vosk_audio_seconds_total it is the real-time factor" },
+	{ "vosk_partial_results_total",         "Partial results returned" },
+	{ "vosk_final_results_total",           "Final results returned" },
+	{ "vosk_queue_dropped_seconds_total",   "Seconds of audio dropped as the queue of a waiting session was full" },
+	{ "vosk_silence_skipped_seconds_total", "Seconds of silence not passed to the recognizers" },
+	{ "vosk_partials_coalesced_total",      "Partial results not sent as a newer result was ready before" },
+	{ "vosk_partials_skipped_total",        "Partial results not handed out as they did not change or changed too soon" },
+	{ "vosk_sent_bytes_total",              "Bytes of results sent to the clients" },
+	{ "vosk_reloads_total",                 "Recognizer reloads completed" },
+};
+
+static const char *gaugeNames[METRIC_GAUGES][2] =
+{
+	{ "vosk_sessions_active",               "Open websocket sessions" },
+	{ "vosk_recognizers_active",            "Recognizer instances" },
+	{ "vosk_recognizers_busy",              "Recognizers decoding a block" },
+	{ "vosk_sessions_waiting",              "Sessions waiting for a recognizer worker" },
+};
+
+static const char *histogramNames[METRIC_HISTOGRAMS][2] =
+{
+	{ "vosk_block_decode_seconds",          "Decoding time of one block of audio" },
+	{ "vosk_accept_seconds",                "Time to resample a chunk of audio and hand it to the recognizer" },
+	{ "vosk_partial_latency_seconds",       "Time from receiving a chunk until its partial result is ready" },
+	{ "vosk_final_latency_seconds",         "Time from receiving a chunk until its final result is ready" },
+	{ "vosk_queue_wait_seconds",            "Time a session waited for a recognizer" },
+};
+
+//////////////////////////////////////////////
+void metricsInit(void)
+{
+	Metrics *shared;
+	
+	if (metrics != &localMetrics)
+	{
+		return;
+	}
+	
+	shared = (Metrics*) mmap(NULL, sizeof(Metrics), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	
+	if (shared == MAP_FAILED)
+	{
+		// the workers' metrics stay in the workers then
+		return;
+	}
+	
+	memcpy(shared, &localMetrics, sizeof(Metrics));
+	metrics = shared;
+}
+
+//////////////////////////////////////////////
+void metricsAdd(MetricCounter counter, long long value)
+{
+	__atomic_fetch_add(&metrics->counters[counter], value, __ATOMIC_RELAXED);
+}
+
+void metricsGaugeAdd(MetricGauge gauge, long long value)
+{
+	__atomic_fetch_add(&metrics->gauges[metricsProcess][gauge], value, __ATOMIC_RELAXED);
+}
+
+void metricsObserve(MetricHistogram histogram, double seconds)
+{
+	Histogram *h = &metrics->histograms[histogram];
+	unsigned int bucket = 0;
+	
+	while ((bucket < HISTOGRAM_BUCKETS - 1) && (seconds > histogramBounds[bucket]))
+	{
+		bucket++;
+	}
+	
+	__atomic_fetch_add(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sumMicroseconds, (unsigned long long) (seconds * 1e6), __ATOMIC_RELAXED);
+}
+
+void metricsSetBacklog(int workerId, int samples)
+{
+	if ((workerId >= 1) && (workerId <= METRICS_MAX_WORKERS))
+	{
+		__atomic_store_n(&metrics->backlogs[metricsProcess][workerId - 1], samples, __ATOMIC_RELAXED);
+	}
+}
+
+//////////////////////////////////////////////
+void metricsSetProcess(int index, int processes)
+{
+	if ((index >= 0) && (index < METRICS_MAX_PROCESSES))
+	{
+		metricsProcess = index;
+	}
+	
+	__atomic_store_n(&metrics->processes, processes, __ATOMIC_RELAXED);
+}
+
+void metricsClearProcess(int index)
+{
+	int i;
+	
+	if ((index < 0) || (index >= METRICS_MAX_PROCESSES))
+	{
+		return;
+	}
+	
+	for (i = 0; i < METRIC_GAUGES; i++)
+	{
+		__atomic_store_n(&metrics->gauges[index][i], 0, __ATOMIC_RELAXED);
+	}
+	
+	for (i = 0; i < METRICS_MAX_WORKERS; i++)
+	{
+		__atomic_store_n(&metrics->backlogs[index][i], 0, __ATOMIC_RELAXED);
+	}
+}
+
+long long metricsProcessGauge(int index, MetricGauge gauge)
+{
+	if ((index < 0) || (index >= METRICS_MAX_PROCESSES))
+	{
+		return 0;
+	}
+	
+	return __atomic_load_n(&metrics->gauges[index][gauge], __ATOMIC_RELAXED);
+}
+
+//////////////////////////////////////////////
+double metricsTime(void)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+//////////////////////////////////////////////
+//
+// counters of samples and microseconds are converted to seconds,
+// the values of a histogram may be slightly inconsistent as they are read one by one
+//
+//////////////////////////////////////////////
+char *metricsRender(size_t *length)
+{
+	char *text = NULL;
+	FILE *out = open_memstream(&text, length);
+	int process;
+	int i;
+	
+	if (out == NULL)
+	{
+		return NULL;
+	}
+	
+	for (i = 0; i < METRIC_COUNTERS; i++)
+	{
+		long long value = __atomic_load_n(&metrics->counters[i], __ATOMIC_RELAXED);
+		
+		fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", counterNames[i][0], counterNames[i][1], counterNames[i][0]);
+		
+		if ((i == METRIC_AUDIO_SAMPLES) || (i == METRIC_QUEUE_DROPPED_SAMPLES) || (i == METRIC_SILENCE_SAMPLES))
+		{
+			fprintf(out, "%s %.3f\n", counterNames[i][0], value / 16000.0);
+		}
+		else if (i == METRIC_DECODE_MICROSECONDS)
+		{
+			fprintf(out, "%s %.6f\n", counterNames[i][0], value * 1e-6);
+		}
+		else
+		{
+			fprintf(out, "%s %lld\n", counterNames[i][0], value);
+		}
+	}
+	
+	// the sum of all server processes
+	for (i = 0; i < METRIC_GAUGES; i++)
+	{
+		long long value = 0;
+		
+		for (process = 0; process < METRICS_MAX_PROCESSES; process++)
+		{
+			value += __atomic_load_n(&metrics->gauges[process][i], __ATOMIC_RELAXED);
+		}
+		
+		fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n", gaugeNames[i][0], gaugeNames[i][1], gaugeNames[i][0],
+			gaugeNames[i][0], value);
+	}
+	
+	fprintf(out, "# HELP vosk_worker_backlog_seconds Audio waiting in the ring of a recognizer worker\n# TYPE vosk_worker_backlog_seconds gauge\n");
+	
+	for (process = 0; process < METRICS_MAX_PROCESSES; process++)
+	{
+		for (i = 0; i < METRICS_MAX_WORKERS; i++)
+		{
+			int samples = __atomic_load_n(&metrics->backlogs[process][i], __ATOMIC_RELAXED);
+			
+			if (samples == 0)
+			{
+				continue;
+			}
+			
+			if (__atomic_load_n(&metrics->processes, __ATOMIC_RELAXED) > 1)
+			{
+				fprintf(out, "vosk_worker_backlog_seconds{process=\"%d\",worker=\"%d\"} %.3f\n", process, i + 1, samples / 16000.0);
+			}
+			else
+			{
+				fprintf(out, "vosk_worker_backlog_seconds{worker=\"%d\"} %.3f\n", i + 1, samples / 16000.0);
+			}
+		}
+	}
+	
+	for (i = 0; i < METRIC_HISTOGRAMS; i++)
+	{
+		const Histogram *h = &metrics->histograms[i];
+		unsigned long long cumulative = 0;
+		unsigned int bucket;
+		
+		fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", histogramNames[i][0], histogramNames[i][1], histogramNames[i][0]);
+		
+		for (bucket = 0; bucket < HISTOGRAM_BUCKETS - 1; bucket++)
+		{
+			cumulative += __atomic_load_n(&h->buckets[bucket], __ATOMIC_RELAXED);
+			fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", histogramNames[i][0], histogramBounds[bucket], cumulative);
+		}
+		
+		cumulative += __atomic_load_n(&h->buckets[bucket], __ATOMIC_RELAXED);
+		fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", histogramNames[i][0], cumulative);
+		fprintf(out, "%s_sum %.6f\n", histogramNames[i][0], __atomic_load_n(&h->sumMicroseconds, __ATOMIC_RELAXED) * 1e-6);
+		fprintf(out, "%s_count %llu\n", histogramNames[i][0], cumulative);
+	}
+	
+	fclose(out);
+	
+	return text;
+}
@@ -0,0 +1,81 @@
+/* Lock-free counters and latency histograms, rendered in the Prometheus text format */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum MetricCounter
+{
+	METRIC_CHUNKS,                // chunks received
+	METRIC_CHUNKS_QUEUED,         // the session had to wait for a recognizer worker
+	METRIC_CHUNKS_IGNORED,        // the recognizer worker was gone
+	METRIC_AUDIO_SAMPLES,         // 16kHz samples decoded
+	METRIC_DECODE_MICROSECONDS,   // time the recognizers spent decoding them
+	METRIC_RESULTS_PARTIAL,
+	METRIC_RESULTS_FINAL,
+	METRIC_QUEUE_DROPPED_SAMPLES, // 16kHz samples dropped from full session queues
+	METRIC_SILENCE_SAMPLES,       // 16kHz samples of silence not passed to the recognizer
+	METRIC_PARTIALS_COALESCED,    // partial results replaced by a newer result before they were sent
+	METRIC_PARTIALS_SKIPPED,      // partial results not handed out as they did not change, or too soon
+	METRIC_SENT_BYTES,            // results sent to the clients
+	METRIC_RELOADS,               // recognizer reloads completed
+	METRIC_COUNTERS
+} MetricCounter;
+
+typedef enum MetricGauge
+{
+	METRIC_SESSIONS_ACTIVE,
+	METRIC_RECOGNIZERS_ACTIVE,
+	METRIC_RECOGNIZERS_BUSY,      // recognizers decoding a block right now (busy, not yet idle again)
+	METRIC_SESSIONS_WAITING,      // sessions waiting for a recognizer worker
+	METRIC_GAUGES
+} MetricGauge;
+
+typedef enum MetricHistogram
+{
+	METRIC_BLOCK_DECODE_SECONDS,     // one PABUF_SIZE block in the recognizer
+	METRIC_ACCEPT_SECONDS,           // resampling and queueing one chunk
+	METRIC_PARTIAL_LATENCY_SECONDS,  // chunk received until its partial result is ready
+	METRIC_FINAL_LATENCY_SECONDS,    // chunk received until its final result is ready
+	METRIC_QUEUE_WAIT_SECONDS,       // a session waiting for a recognizer worker
+	METRIC_HISTOGRAMS
+} MetricHistogram;
+
+// moves the metrics to memory shared with processes forked afterwards,
+// so the recognizer workers count into the same metrics
+void metricsInit(void);
+
+void metricsAdd(MetricCounter counter, long long value);
+void metricsGaugeAdd(MetricGauge gauge, long long value);
+void metricsObserve(MetricHistogram histogram, double seconds);
+
+// backlog of one recognizer worker (workerId starting at 1), in 16kHz samples
+void metricsSetBacklog(int workerId, int samples);
+
+// server processes forked after metricsInit() share the metrics, counters and histograms
+// add up, gauges and backlogs are kept per process (index 0 .. METRICS_MAX_PROCESSES - 1),
+// so those of a process that died can be cleared
+#define METRICS_MAX_PROCESSES 16
+
+void metricsSetProcess(int index, int processes);
+void metricsClearProcess(int index);
+
+// gauge of one server process, for spreading sessions by load
+long long metricsProcessGauge(int index, MetricGauge gauge);
+
+// monotonic clock in seconds, for measuring durations
+double metricsTime(void);
+
+// all metrics as text, to be released with free()
+char *metricsRender(size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_H */
@@ -0,0 +1,122 @@
+
+#include "pcm_convert.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCM_CONVERT_X86 1
+#endif
+
+// float32 format for portaudio means values are between -1.0 and +1.0, so one multiply does the scaling
+#define PCM_SCALE (1.0f / 32768.0f)
+
+//////////////////////////////////////////////
+void pcmToFloatScalar(const unsigned char *data, int count, float *output)
+{
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		// data from jitsi is 16 bit integers in little endian
+		short value = (short) (data[2 * i] | (data[2 * i + 1] << 8));
+		
+		output[i] = (float) value * PCM_SCALE;
+	}
+}
+
+#ifdef PCM_CONVERT_X86
+
+//////////////////////////////////////////////
+//
+// 8 samples per step, sign extension by unpacking into the upper half and shifting back
+//
+//////////////////////////////////////////////
+__attribute__ ((target ("sse2")))
+static void pcmToFloatSse2(const unsigned char *data, int count, float *output)
+{
+	const __m128 scale = _mm_set1_ps(PCM_SCALE);
+	int i;
+	
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		__m128i pcm  = _mm_loadu_si128((const __m128i*) (data + 2 * i));
+		__m128i low  = _mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16);
+		__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(pcm, pcm), 16);
+		
+		_mm_storeu_ps(output + i,     _mm_mul_ps(_mm_cvtepi32_ps(low),  scale));
+		_mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+	}
+	
+	pcmToFloatScalar(data + 2 * i, count - i, output + i);
+}
+
+//////////////////////////////////////////////
+//
+// 16 samples per step
+//
+//////////////////////////////////////////////
+__attribute__ ((target ("avx2")))
+static void pcmToFloatAvx2(const unsigned char *data, int count, float *output)
+{
+	const __m256 scale = _mm256_set1_ps(PCM_SCALE);
+	int i;
+	
+	for (i = 0; i + 16 <= count; i += 16)
+	{
+		__m256i low  = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) (data + 2 * i)));
+		__m256i high = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) (data + 2 * i + 16)));
+		
+		_mm256_storeu_ps(output + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(low),  scale));
+		_mm256_storeu_ps(output + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), scale));
+	}
+	
+	pcmToFloatScalar(data + 2 * i, count - i, output + i);
+}
+
+#endif
+
+//////////////////////////////////////////////
+//
+// runtime dispatch, resolved on first use
+//
+//////////////////////////////////////////////
+typedef void (*PcmToFloatFunction)(const unsigned char *data, int count, float *output);
+
+static PcmToFloatFunction pcmToFloatSelected = pcmToFloatScalar;
+static const char        *pcmToFloatName     = "scalar";
+static pthread_once_t     pcmToFloatOnce     = PTHREAD_ONCE_INIT;
+
+static void selectPcmToFloat(void)
+{
+#ifdef PCM_CONVERT_X86
+	__builtin_cpu_init();
+	
+	if (__builtin_cpu_supports("avx2"))
+	{
+		pcmToFloatSelected = pcmToFloatAvx2;
+		pcmToFloatName     = "avx2";
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		pcmToFloatSelected = pcmToFloatSse2;
+		pcmToFloatName     = "sse2";
+	}
+#endif
+}
+
+//////////////////////////////////////////////
+void pcmToFloat(const unsigned char *data, int count, float *output)
+{
+	pthread_once(&pcmToFloatOnce, selectPcmToFloat);
+	
+	pcmToFloatSelected(data, count, output);
+}
+
+//////////////////////////////////////////////
+const char *pcmToFloatImplementation(void)
+{
+	pthread_once(&pcmToFloatOnce, selectPcmToFloat);
+	
+	return pcmToFloatName;
+}
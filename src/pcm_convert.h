@@ -0,0 +1,16 @@
+/* Conversion of 16 bit PCM from the clients to the float format of the recognizer */
+
+#ifndef PCM_CONVERT_H
+#define PCM_CONVERT_H
+
+// converts count little endian 16 bit samples to floats between -1.0 and +1.0,
+// data needs no particular alignment
+void pcmToFloat(const unsigned char *data, int count, float *output);
+
+// name of the implementation picked for this CPU, for logging and benchmarks
+const char *pcmToFloatImplementation(void);
+
+// the portable version, also used for the tail of each chunk
+void pcmToFloatScalar(const unsigned char *data, int count, float *output);
+
+#endif /* PCM_CONVERT_H */
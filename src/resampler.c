@@ -0,0 +1,335 @@
+
+#include "resampler.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+//////////////////////////////////////////////
+//
+// filter design parameters
+//
+//////////////////////////////////////////////
+
+// zero crossings of the sinc on each side, at the lower of both rates
+#define RESAMPLER_ZERO_CROSSINGS 16
+
+// cutoff relative to the lower Nyquist frequency, leaves room for the transition band
+#define RESAMPLER_ROLLOFF        0.9
+
+// Kaiser window shape, about 80dB stopband attenuation
+#define RESAMPLER_KAISER_BETA    8.0
+
+// keeps the tables small for odd rate pairs like 44.1kHz -> 16kHz (160 phases)
+#define RESAMPLER_MAX_PHASES     1024
+
+// taps per phase are rounded up to the vector width used in dotProduct()
+#define RESAMPLER_TAP_ALIGN      8
+
+//////////////////////////////////////////////
+struct ResamplerFilter
+{
+	int    inputRate;
+	int    outputRate;
+	int    upFactor;         // L, number of phases
+	int    downFactor;       // M
+	int    tapsPerPhase;     // T
+	
+	// L phases of T taps each, every phase stored in reverse order,
+	// so one output sample is a plain dot product over consecutive input samples
+	float *coefficients;
+	
+	struct ResamplerFilter *next;
+};
+
+// filters are built once per rate pair and live as long as the process
+static ResamplerFilter *filterCache = NULL;
+static pthread_mutex_t  filterCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//////////////////////////////////////////////
+static int greatestCommonDivisor(int a, int b)
+{
+	while (b != 0)
+	{
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	
+	return a;
+}
+
+//////////////////////////////////////////////
+//
+// zeroth order modified Bessel function, for the Kaiser window
+//
+//////////////////////////////////////////////
+static double besselI0(double x)
+{
+	double sum  = 1.0;
+	double term = 1.0;
+	int k;
+	
+	for (k = 1; k < 50; k++)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum  += term;
+		
+		if (term < sum * 1e-12)
+		{
+			break;
+		}
+	}
+	
+	return sum;
+}
+
+//////////////////////////////////////////////
+//
+// windowed sinc lowpass at the upsampled rate, split into polyphase components
+//
+//////////////////////////////////////////////
+static ResamplerFilter *createFilter(int inputRate, int outputRate)
+{
+	ResamplerFilter *filter;
+	int divisor = greatestCommonDivisor(inputRate, outputRate);
+	int upFactor = outputRate / divisor;
+	int downFactor = inputRate / divisor;
+	int maxFactor = (upFactor > downFactor) ? upFactor : downFactor;
+	int tapsPerPhase, length, phase, tap;
+	double cutoff, center;
+	
+	if (upFactor > RESAMPLER_MAX_PHASES)
+	{
+		return NULL;
+	}
+	
+	tapsPerPhase = (2 * RESAMPLER_ZERO_CROSSINGS * maxFactor + upFactor - 1) / upFactor;
+	tapsPerPhase = ((tapsPerPhase + RESAMPLER_TAP_ALIGN - 1) / RESAMPLER_TAP_ALIGN) * RESAMPLER_TAP_ALIGN;
+	length = tapsPerPhase * upFactor;
+	
+	filter = (ResamplerFilter*) malloc(sizeof(ResamplerFilter));
+	filter->inputRate    = inputRate;
+	filter->outputRate   = outputRate;
+	filter->upFactor     = upFactor;
+	filter->downFactor   = downFactor;
+	filter->tapsPerPhase = tapsPerPhase;
+	filter->coefficients = (float*) malloc(length * sizeof(float));
+	filter->next         = NULL;
+	
+	// cycles per sample at the upsampled rate
+	cutoff = RESAMPLER_ROLLOFF * 0.5 / maxFactor;
+	center = (length - 1) / 2.0;
+	
+	for (phase = 0; phase < upFactor; phase++)
+	{
+		for (tap = 0; tap < tapsPerPhase; tap++)
+		{
+			// tap t of phase p is h[p + t * L], stored reversed
+			int index = phase + tap * upFactor;
+			double x = index - center;
+			double ratio = x / (center + 0.5);
+			double sinc = (x == 0.0) ? 1.0 : sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+			double window = besselI0(RESAMPLER_KAISER_BETA * sqrt(1.0 - ratio * ratio)) / besselI0(RESAMPLER_KAISER_BETA);
+			
+			// the gain of L makes up for the zeros inserted by upsampling
+			filter->coefficients[phase * tapsPerPhase + (tapsPerPhase - 1 - tap)] = (float) (2.0 * cutoff * sinc * window * upFactor);
+		}
+	}
+	
+	logInfo("Created resampler %d -> %d Hz, L=%d, M=%d, %d taps per phase.\n", inputRate, outputRate, upFactor, downFactor, tapsPerPhase);
+	
+	return filter;
+}
+
+//////////////////////////////////////////////
+static const ResamplerFilter *getFilter(int inputRate, int outputRate)
+{
+	ResamplerFilter *filter;
+	
+	pthread_mutex_lock(&filterCacheMutex);
+	
+	for (filter = filterCache; filter != NULL; filter = filter->next)
+	{
+		if ((filter->inputRate == inputRate) && (filter->outputRate == outputRate))
+		{
+			break;
+		}
+	}
+	
+	if (filter == NULL)
+	{
+		filter = createFilter(inputRate, outputRate);
+		
+		if (filter != NULL)
+		{
+			filter->next = filterCache;
+			filterCache = filter;
+		}
+	}
+	
+	pthread_mutex_unlock(&filterCacheMutex);
+	
+	return filter;
+}
+
+//////////////////////////////////////////////
+//
+// GCC vector extensions, compiles to SSE on x86-64 and NEON on ARM
+//
+//////////////////////////////////////////////
+typedef float Float4 __attribute__ ((vector_size (16)));
+
+static float dotProduct(const float *a, const float *b, int count)
+{
+	Float4 acc0 = { 0.0f, 0.0f, 0.0f, 0.0f };
+	Float4 acc1 = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float sum;
+	int i;
+	
+	for (i = 0; i + 8 <= count; i += 8)
+	{
+		Float4 a0, a1, b0, b1;
+		
+		// the input is not necessarily aligned
+		memcpy(&a0, a + i,     sizeof(Float4));
+		memcpy(&a1, a + i + 4, sizeof(Float4));
+		memcpy(&b0, b + i,     sizeof(Float4));
+		memcpy(&b1, b + i + 4, sizeof(Float4));
+		
+		acc0 += a0 * b0;
+		acc1 += a1 * b1;
+	}
+	
+	acc0 += acc1;
+	sum = acc0[0] + acc0[1] + acc0[2] + acc0[3];
+	
+	for (; i < count; i++)
+	{
+		sum += a[i] * b[i];
+	}
+	
+	return sum;
+}
+
+//////////////////////////////////////////////
+int resamplerInit(Resampler *resampler, int inputRate, int outputRate)
+{
+	memset(resampler, 0, sizeof(Resampler));
+	
+	if ((inputRate <= 0) || (outputRate <= 0))
+	{
+		return 0;
+	}
+	
+	if (inputRate == outputRate)
+	{
+		return 1;
+	}
+	
+	resampler->filter = getFilter(inputRate, outputRate);
+	
+	if (resampler->filter == NULL)
+	{
+		return 0;
+	}
+	
+	resamplerReset(resampler);
+	
+	return 1;
+}
+
+//////////////////////////////////////////////
+void resamplerFree(Resampler *resampler)
+{
+	free(resampler->history);
+	memset(resampler, 0, sizeof(Resampler));
+}
+
+//////////////////////////////////////////////
+void resamplerReset(Resampler *resampler)
+{
+	int carried;
+	
+	if (resampler->filter == NULL)
+	{
+		return;
+	}
+	
+	// the stream starts with silence in the filter
+	carried = resampler->filter->tapsPerPhase - 1;
+	
+	if (resampler->historyCapacity < carried)
+	{
+		resampler->history = (float*) realloc(resampler->history, carried * sizeof(float));
+		resampler->historyCapacity = carried;
+	}
+	
+	memset(resampler->history, 0, carried * sizeof(float));
+	resampler->historyLength = carried;
+	resampler->inputIndex    = carried;
+	resampler->phase         = 0;
+}
+
+//////////////////////////////////////////////
+int resamplerMaxOutput(const Resampler *resampler, int inputCount)
+{
+	if (resampler->filter == NULL)
+	{
+		return inputCount;
+	}
+	
+	return (int) (((long long) inputCount * resampler->filter->upFactor) / resampler->filter->downFactor) + 1;
+}
+
+//////////////////////////////////////////////
+int resamplerProcess(Resampler *resampler, const float *input, int inputCount, float *output)
+{
+	const ResamplerFilter *filter = resampler->filter;
+	int outputCount = 0;
+	int taps, carried, consumed;
+	
+	if (filter == NULL)
+	{
+		memcpy(output, input, inputCount * sizeof(float));
+		return inputCount;
+	}
+	
+	taps = filter->tapsPerPhase;
+	
+	// append the new input behind the carried samples
+	if (resampler->historyLength + inputCount > resampler->historyCapacity)
+	{
+		resampler->historyCapacity = resampler->historyLength + inputCount;
+		resampler->history = (float*) realloc(resampler->history, resampler->historyCapacity * sizeof(float));
+	}
+	
+	memcpy(resampler->history + resampler->historyLength, input, inputCount * sizeof(float));
+	resampler->historyLength += inputCount;
+	
+	// output k sits at k * M in the upsampled stream, which is input (k * M) / L with phase (k * M) % L
+	while (resampler->inputIndex < resampler->historyLength)
+	{
+		const float *coefficients = filter->coefficients + resampler->phase * taps;
+		
+		output[outputCount] = dotProduct(coefficients, resampler->history + resampler->inputIndex - (taps - 1), taps);
+		outputCount++;
+		
+		resampler->phase      += filter->downFactor;
+		resampler->inputIndex += resampler->phase / filter->upFactor;
+		resampler->phase      %= filter->upFactor;
+	}
+	
+	// keep what the filter still needs for the next chunk
+	carried  = taps - 1;
+	consumed = resampler->historyLength - carried;
+	
+	memmove(resampler->history, resampler->history + consumed, carried * sizeof(float));
+	resampler->historyLength = carried;
+	resampler->inputIndex   -= consumed;
+	
+	return outputCount;
+}
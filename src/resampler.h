@@ -0,0 +1,36 @@
+/* Polyphase FIR resampler for bringing client audio to the rate of the recognizer */
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+// filter tables are shared by all resamplers with the same rates
+typedef struct ResamplerFilter ResamplerFilter;
+
+typedef struct Resampler
+{
+	const ResamplerFilter *filter;   // NULL if input and output rate are the same
+
+	// input samples still needed for upcoming outputs, carried from chunk to chunk
+	float *history;
+	int    historyLength;
+	int    historyCapacity;
+
+	// position of the next output sample: newest input sample and filter phase
+	int    inputIndex;
+	int    phase;
+} Resampler;
+
+// returns 0 if the rates cannot be converted, the resampler passes samples through then
+int  resamplerInit(Resampler *resampler, int inputRate, int outputRate);
+void resamplerFree(Resampler *resampler);
+
+// forget the carried input, e.g. when a new stream starts
+void resamplerReset(Resampler *resampler);
+
+// upper limit of output samples for the given number of input samples
+int  resamplerMaxOutput(const Resampler *resampler, int inputCount);
+
+// returns the number of samples written to output
+int  resamplerProcess(Resampler *resampler, const float *input, int inputCount, float *output);
+
+#endif /* RESAMPLER_H */
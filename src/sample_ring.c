@@ -0,0 +1,126 @@
+
+#include "sample_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//////////////////////////////////////////////
+int sampleRingInit(SampleRing *ring, int capacity)
+{
+	int size = 1;
+	
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+	
+	ring->data = (float*) malloc(size * sizeof(float));
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	
+	return (ring->data != NULL);
+}
+
+//////////////////////////////////////////////
+void sampleRingFree(SampleRing *ring)
+{
+	free(ring->data);
+	memset(ring, 0, sizeof(SampleRing));
+}
+
+//////////////////////////////////////////////
+//
+// copies count samples starting at counter position, wrapping around the end
+//
+//////////////////////////////////////////////
+static void copyIn(SampleRing *ring, unsigned int position, const float *samples, int count)
+{
+	int offset = position & ring->mask;
+	int first  = ring->mask + 1 - offset;
+	
+	if (first > count)
+	{
+		first = count;
+	}
+	
+	memcpy(ring->data + offset, samples, first * sizeof(float));
+	memcpy(ring->data, samples + first, (count - first) * sizeof(float));
+}
+
+static void copyOut(const SampleRing *ring, unsigned int position, float *samples, int count)
+{
+	int offset = position & ring->mask;
+	int first  = ring->mask + 1 - offset;
+	
+	if (first > count)
+	{
+		first = count;
+	}
+	
+	memcpy(samples, ring->data + offset, first * sizeof(float));
+	memcpy(samples + first, ring->data, (count - first) * sizeof(float));
+}
+
+//////////////////////////////////////////////
+//
+// the counters only ever grow (wrapping at 2^32), their difference is the fill level;
+// release on the own counter publishes the copied samples, acquire on the other
+// counter makes sure its samples (or free space) are really there
+//
+//////////////////////////////////////////////
+int sampleRingWrite(SampleRing *ring, const float *samples, int count)
+{
+	unsigned int head = ring->head;
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	int space = ring->mask + 1 - (int) (head - tail);
+	
+	if (count > space)
+	{
+		count = space;
+	}
+	
+	if (count > 0)
+	{
+		copyIn(ring, head, samples, count);
+		__atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);
+	}
+	
+	return count;
+}
+
+//////////////////////////////////////////////
+int sampleRingRead(SampleRing *ring, float *samples, int count)
+{
+	unsigned int tail = ring->tail;
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	int available = (int) (head - tail);
+	
+	if (count > available)
+	{
+		count = available;
+	}
+	
+	if (count > 0)
+	{
+		copyOut(ring, tail, samples, count);
+		__atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+	}
+	
+	return count;
+}
+
+//////////////////////////////////////////////
+int sampleRingFill(const SampleRing *ring)
+{
+	unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+	unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+	
+	return (int) (head - tail);
+}
+
+//////////////////////////////////////////////
+int sampleRingCapacity(const SampleRing *ring)
+{
+	return ring->mask + 1;
+}
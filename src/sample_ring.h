@@ -0,0 +1,30 @@
+/* Lock-free single producer / single consumer ring of audio samples */
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+typedef struct SampleRing
+{
+	float *data;
+	int    mask;         // capacity - 1, the capacity is a power of 2
+
+	// running counters, only the producer writes head, only the consumer writes tail
+	unsigned int head;
+	unsigned int tail;
+} SampleRing;
+
+// capacity is rounded up to the next power of 2, returns 0 if out of memory
+int  sampleRingInit(SampleRing *ring, int capacity);
+void sampleRingFree(SampleRing *ring);
+
+// producer side, returns the number of samples stored (less than count if the ring is full)
+int  sampleRingWrite(SampleRing *ring, const float *samples, int count);
+
+// consumer side, returns the number of samples taken (less than count if the ring runs empty)
+int  sampleRingRead(SampleRing *ring, float *samples, int count);
+
+// samples waiting for the consumer, may be called from any thread
+int  sampleRingFill(const SampleRing *ring);
+int  sampleRingCapacity(const SampleRing *ring);
+
+#endif /* SAMPLE_RING_H */
@@ -0,0 +1,225 @@
+
+#include "voice_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// hiss and clicks cross zero far more often than voice, such frames need a louder signal to count
+#define VOICE_FILTER_MAX_CROSSINGS (VOICE_FILTER_FRAME / 2)
+#define VOICE_FILTER_NOISE_FACTOR  10.0f    // 10dB above the threshold
+
+//////////////////////////////////////////////
+//
+// GCC vector extensions, compiles to SSE on x86-64 and NEON on ARM
+//
+//////////////////////////////////////////////
+typedef float Float4 __attribute__ ((vector_size (16)));
+typedef int   Int4   __attribute__ ((vector_size (16)));
+
+// energy (mean square) and number of sign changes of one frame
+static float frameStatistics(const float *frame, float previous, int *crossings)
+{
+	Float4 energy = { 0.0f, 0.0f, 0.0f, 0.0f };
+	Int4   changes = { 0, 0, 0, 0 };
+	Float4 x, last;
+	int i;
+	
+	// the first step needs the sample before the frame
+	memcpy(&x, frame, sizeof(Float4));
+	last[0] = previous;
+	last[1] = frame[0];
+	last[2] = frame[1];
+	last[3] = frame[2];
+	
+	energy  += x * x;
+	changes += (x * last < 0.0f);
+	
+	for (i = 4; i < VOICE_FILTER_FRAME; i += 4)
+	{
+		// the input is not necessarily aligned
+		memcpy(&x,    frame + i,     sizeof(Float4));
+		memcpy(&last, frame + i - 1, sizeof(Float4));
+		
+		energy  += x * x;
+		changes += (x * last < 0.0f);    // -1 where the sign changes
+	}
+	
+	*crossings = -(changes[0] + changes[1] + changes[2] + changes[3]);
+	
+	return (energy[0] + energy[1] + energy[2] + energy[3]) / VOICE_FILTER_FRAME;
+}
+
+//////////////////////////////////////////////
+void voiceFilterInit(VoiceFilter *filter, float thresholdDb, int hangoverMs, int prerollMs)
+{
+	memset(filter, 0, sizeof(VoiceFilter));
+	
+	filter->energyThreshold = powf(10.0f, thresholdDb / 10.0f);
+	filter->hangoverFrames  = (hangoverMs > 0) ? hangoverMs / 10 : 0;
+	filter->prerollFrames   = (prerollMs > 0) ? prerollMs / 10 : 0;
+	
+	if (filter->prerollFrames > 0)
+	{
+		filter->preroll = (float*) malloc(filter->prerollFrames * VOICE_FILTER_FRAME * sizeof(float));
+	}
+}
+
+void voiceFilterFree(VoiceFilter *filter)
+{
+	free(filter->preroll);
+	filter->preroll = NULL;
+}
+
+//////////////////////////////////////////////
+int voiceFilterMaxOutput(const VoiceFilter *filter, int inputCount)
+{
+	return inputCount + (filter->prerollFrames + 1) * VOICE_FILTER_FRAME;
+}
+
+//////////////////////////////////////////////
+//
+// one complete frame, returns the number of samples written to output
+//
+// without output the frame stays where it is if it passes, only
+// when there is no pre-roll waiting (which would have to go first)
+//
+//////////////////////////////////////////////
+static int processFrame(VoiceFilter *filter, const float *frame, float *output)
+{
+	int crossings, written = 0;
+	float energy = frameStatistics(frame, filter->lastSample, &crossings);
+	int voiced = (energy >= filter->energyThreshold) &&
+		((crossings <= VOICE_FILTER_MAX_CROSSINGS) || (energy >= filter->energyThreshold * VOICE_FILTER_NOISE_FACTOR));
+	
+	filter->lastSample = frame[VOICE_FILTER_FRAME - 1];
+	
+	if (voiced != 0)
+	{
+		// onset, the silence before it goes first
+		while (filter->prerollCount > 0)
+		{
+			memcpy(output + written, filter->preroll + filter->prerollHead * VOICE_FILTER_FRAME, VOICE_FILTER_FRAME * sizeof(float));
+			written += VOICE_FILTER_FRAME;
+			
+			filter->prerollHead = (filter->prerollHead + 1) % filter->prerollFrames;
+			filter->prerollCount--;
+		}
+		
+		filter->hangover = filter->hangoverFrames;
+	}
+	else if (filter->hangover > 0)
+	{
+		// the recognizer needs some silence to end the utterance
+		filter->hangover--;
+	}
+	else
+	{
+		if (filter->prerollFrames == 0)
+		{
+			filter->droppedSamples += VOICE_FILTER_FRAME;
+			return 0;
+		}
+		
+		// the oldest frame of the pre-roll falls out
+		if (filter->prerollCount == filter->prerollFrames)
+		{
+			filter->prerollHead = (filter->prerollHead + 1) % filter->prerollFrames;
+			filter->prerollCount--;
+			filter->droppedSamples += VOICE_FILTER_FRAME;
+		}
+		
+		memcpy(filter->preroll + ((filter->prerollHead + filter->prerollCount) % filter->prerollFrames) * VOICE_FILTER_FRAME,
+			frame, VOICE_FILTER_FRAME * sizeof(float));
+		filter->prerollCount++;
+		
+		return 0;
+	}
+	
+	if (output != NULL)
+	{
+		memcpy(output + written, frame, VOICE_FILTER_FRAME * sizeof(float));
+	}
+	
+	return written + VOICE_FILTER_FRAME;
+}
+
+//////////////////////////////////////////////
+//
+// as long as every frame passes, the input is not copied: the passed
+// frames are the start of the input then, and the input is returned
+//
+//////////////////////////////////////////////
+const float *voiceFilterPass(VoiceFilter *filter, const float *input, int inputCount, float *output, int *outputCount)
+{
+	int inPlace = (filter->frameFill == 0);
+	int written = 0;
+	int i = 0;
+	
+	// complete the frame left over from the last call
+	if (filter->frameFill > 0)
+	{
+		int count = VOICE_FILTER_FRAME - filter->frameFill;
+		
+		if (count > inputCount)
+		{
+			count = inputCount;
+		}
+		
+		memcpy(filter->frame + filter->frameFill, input, count * sizeof(float));
+		filter->frameFill += count;
+		i = count;
+		
+		if (filter->frameFill < VOICE_FILTER_FRAME)
+		{
+			*outputCount = 0;
+			return output;
+		}
+		
+		written += processFrame(filter, filter->frame, output);
+		filter->frameFill = 0;
+	}
+	
+	// whole frames straight from the input
+	for (; i + VOICE_FILTER_FRAME <= inputCount; i += VOICE_FILTER_FRAME)
+	{
+		if ((inPlace != 0) && (filter->prerollCount == 0))
+		{
+			if (processFrame(filter, input + i, NULL) > 0)
+			{
+				written += VOICE_FILTER_FRAME;
+				continue;
+			}
+			
+			// dropped, the frames before it go to the output after all
+			memcpy(output, input, written * sizeof(float));
+			inPlace = 0;
+			continue;
+		}
+		
+		if (inPlace != 0)
+		{
+			memcpy(output, input, written * sizeof(float));
+			inPlace = 0;
+		}
+		
+		written += processFrame(filter, input + i, output + written);
+	}
+	
+	memcpy(filter->frame, input + i, (inputCount - i) * sizeof(float));
+	filter->frameFill = inputCount - i;
+	
+	*outputCount = written;
+	
+	return (inPlace != 0) ? input : output;
+}
+
+//////////////////////////////////////////////
+long long voiceFilterTakeDropped(VoiceFilter *filter)
+{
+	long long dropped = filter->droppedSamples;
+	
+	filter->droppedSamples = 0;
+	
+	return dropped;
+}
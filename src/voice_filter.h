@@ -0,0 +1,45 @@
+/* Energy and zero-crossing voice activity filter, keeps long silence away from the recognizer */
+
+#ifndef VOICE_FILTER_H
+#define VOICE_FILTER_H
+
+// 10ms at 16kHz, the unit of all decisions
+#define VOICE_FILTER_FRAME 160
+
+typedef struct VoiceFilter
+{
+	// frame collected across chunks
+	float frame[VOICE_FILTER_FRAME];
+	int   frameFill;
+	float lastSample;          // for the zero-crossing at the start of a frame
+	
+	// silent frames kept for the onset of the next utterance
+	float *preroll;
+	int    prerollFrames;
+	int    prerollCount;
+	int    prerollHead;        // oldest frame
+	
+	// voiced frames are followed by this many frames of silence
+	int   hangoverFrames;
+	int   hangover;            // left of it
+	
+	float energyThreshold;     // mean square of a voiced frame
+	
+	long long droppedSamples;  // since the last voiceFilterTakeDropped()
+} VoiceFilter;
+
+// threshold in dB relative to full scale, times in ms, the input must be 16kHz
+void voiceFilterInit(VoiceFilter *filter, float thresholdDb, int hangoverMs, int prerollMs);
+void voiceFilterFree(VoiceFilter *filter);
+
+// upper limit of output samples for the given number of input samples
+int  voiceFilterMaxOutput(const VoiceFilter *filter, int inputCount);
+
+// passes voiced frames with their pre-roll and hangover, returns where the *outputCount passed samples are:
+// the input itself if it passes as a whole, output otherwise (an incomplete frame at the end waits for the next call)
+const float *voiceFilterPass(VoiceFilter *filter, const float *input, int inputCount, float *output, int *outputCount);
+
+// samples dropped as silence, the counter starts over
+long long voiceFilterTakeDropped(VoiceFilter *filter);
+
+#endif /* VOICE_FILTER_H */
@@ -0,0 +1,572 @@
+
+#include "vosk_api.h"
+#include "vosk_dlabpro_wrapper.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+//////////////////////////////////////////////
+//
+// batch processing on top of the regular recognizer API:
+// one thread per recognizer worker takes a queued stream, feeds all of its
+// chunks as fast as the recognizer decodes, and queues the results
+//
+//////////////////////////////////////////////
+
+typedef struct BatchChunk
+{
+	char *data;
+	int   length;
+	struct BatchChunk *next;
+} BatchChunk;
+
+typedef struct BatchResult
+{
+	char *text;
+	struct BatchResult *next;
+} BatchResult;
+
+//////////////////////////////////////////////
+struct VoskBatchModel
+{
+	VoskModel *model;
+	
+	// protects everything below and all streams, signalled on every state change
+	pthread_mutex_t mutex;
+	pthread_cond_t  cond;
+	
+	VoskBatchRecognizer *streams;
+	
+	pthread_t *threads;
+	int        threadCount;
+	int        exit;
+	
+	// throughput accounting
+	double audioSeconds;
+	struct timespec startTime;
+};
+
+//////////////////////////////////////////////
+struct VoskBatchRecognizer
+{
+	VoskBatchModel *model;
+	VoskRecognizer *recognizer;    // NULL once the stream is done
+	float           sampleRate;
+	
+	BatchChunk *chunksHead;
+	BatchChunk *chunksTail;
+	int         pendingChunks;     // queued plus the one being decoded
+	
+	BatchResult *resultsHead;
+	BatchResult *resultsTail;
+	
+	int finished;                  // no more chunks will come
+	int done;                      // the final result is queued
+	int served;                    // a batch thread owns this stream
+	
+	VoskBatchRecognizer *next;
+};
+
+static const char *batch_result_empty = "";
+
+//////////////////////////////////////////////
+static double secondsSince(const struct timespec *start)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+//////////////////////////////////////////////
+static double cpuSeconds(int who)
+{
+	struct rusage usage;
+	
+	if (getrusage(who, &usage) != 0)
+	{
+		return 0.0;
+	}
+	
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+//////////////////////////////////////////////
+//
+// the helpers below must be called with model->mutex held
+//
+//////////////////////////////////////////////
+static void pushResult(VoskBatchRecognizer *stream, char *text)
+{
+	BatchResult *result = (BatchResult*) malloc(sizeof(BatchResult));
+	
+	result->text = text;
+	result->next = NULL;
+	
+	if (stream->resultsTail != NULL)
+	{
+		stream->resultsTail->next = result;
+	}
+	else
+	{
+		stream->resultsHead = result;
+	}
+	
+	stream->resultsTail = result;
+}
+
+static BatchChunk *popChunk(VoskBatchRecognizer *stream)
+{
+	BatchChunk *chunk = stream->chunksHead;
+	
+	if (chunk != NULL)
+	{
+		stream->chunksHead = chunk->next;
+		
+		if (stream->chunksHead == NULL)
+		{
+			stream->chunksTail = NULL;
+		}
+	}
+	
+	return chunk;
+}
+
+// a stream nobody works on, which has either audio or its final result pending
+static VoskBatchRecognizer *takeStream(VoskBatchModel *model)
+{
+	VoskBatchRecognizer *stream;
+	
+	for (stream = model->streams; stream != NULL; stream = stream->next)
+	{
+		if ((stream->served == 0) && (stream->done == 0) && ((stream->chunksHead != NULL) || (stream->finished != 0)))
+		{
+			stream->served = 1;
+			return stream;
+		}
+	}
+	
+	return NULL;
+}
+
+//////////////////////////////////////////////
+//
+// a stream stays with one thread (and so with one recognizer worker) until it is done,
+// the recognizer keeps the decoding context of the stream
+//
+//////////////////////////////////////////////
+static void *batchThread(void *arg)
+{
+	VoskBatchModel *model = (VoskBatchModel*) arg;
+	VoskBatchRecognizer *stream = NULL;
+	
+	pthread_mutex_lock(&model->mutex);
+	
+	while (model->exit == 0)
+	{
+		BatchChunk *chunk;
+		
+		if (stream == NULL)
+		{
+			stream = takeStream(model);
+			
+			if (stream == NULL)
+			{
+				pthread_cond_wait(&model->cond, &model->mutex);
+			}
+			
+			continue;
+		}
+		
+		chunk = popChunk(stream);
+		
+		if (chunk != NULL)
+		{
+			char *text = NULL;
+			
+			pthread_mutex_unlock(&model->mutex);
+			
+			if (vosk_recognizer_accept_waveform(stream->recognizer, chunk->data, chunk->length) == 1)
+			{
+				text = strdup(vosk_recognizer_result(stream->recognizer));
+			}
+			
+			pthread_mutex_lock(&model->mutex);
+			
+			if (text != NULL)
+			{
+				pushResult(stream, text);
+			}
+			
+			model->audioSeconds += chunk->length / 2 / stream->sampleRate;
+			stream->pendingChunks--;
+			pthread_cond_broadcast(&model->cond);
+			
+			free(chunk->data);
+			free(chunk);
+		}
+		else if (stream->finished != 0)
+		{
+			char *text;
+			
+			pthread_mutex_unlock(&model->mutex);
+			
+			text = strdup(vosk_recognizer_final_result(stream->recognizer));
+			
+			// frees the worker for the next stream right away
+			vosk_recognizer_free(stream->recognizer);
+			
+			pthread_mutex_lock(&model->mutex);
+			
+			pushResult(stream, text);
+			stream->recognizer = NULL;
+			stream->done = 1;
+			stream->served = 0;
+			stream = NULL;
+			pthread_cond_broadcast(&model->cond);
+		}
+		else
+		{
+			// the caller did not send the rest of this stream yet
+			pthread_cond_wait(&model->cond, &model->mutex);
+		}
+	}
+	
+	if (stream != NULL)
+	{
+		stream->served = 0;
+		pthread_cond_broadcast(&model->cond);
+	}
+	
+	pthread_mutex_unlock(&model->mutex);
+	
+	return (void *) NULL;
+}
+
+//////////////////////////////////////////////
+//
+// uses the recognizer of the model path like vosk_model_new(), one batch
+// thread per recognizer worker (see vosk_dlabpro_set_workers())
+//
+//////////////////////////////////////////////
+VoskBatchModel *vosk_batch_model_new(const char *model_path)
+{
+	VoskBatchModel *instance;
+	int i;
+	
+	logInfo("vosk_batch_model_new, path=%s.\n", model_path);
+	
+	instance = (VoskBatchModel*) calloc(1, sizeof(VoskBatchModel));
+	
+	// forks the workers, so this comes before starting our threads
+	instance->model = vosk_model_new(model_path);
+	
+	if (instance->model == NULL)
+	{
+		free(instance);
+		return NULL;
+	}
+	
+	pthread_mutex_init(&instance->mutex, NULL);
+	pthread_cond_init(&instance->cond, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &instance->startTime);
+	
+	instance->threadCount = vosk_dlabpro_get_parallel_recognizers();
+	instance->threads = (pthread_t*) calloc(instance->threadCount, sizeof(pthread_t));
+	
+	for (i = 0; i < instance->threadCount; i++)
+	{
+		int retVal = pthread_create(&instance->threads[i], NULL, batchThread, instance);
+		
+		if (retVal != 0)
+		{
+			logError("batch thread start error: %d.\n", retVal);
+			instance->threadCount = i;
+			break;
+		}
+	}
+	
+	return instance;
+}
+
+//////////////////////////////////////////////
+void vosk_batch_model_free(VoskBatchModel *model)
+{
+	double wallSeconds, cpuTotal;
+	int i;
+	
+	logInfo("vosk_batch_model_free.\n");
+	
+	pthread_mutex_lock(&model->mutex);
+	model->exit = 1;
+	pthread_cond_broadcast(&model->cond);
+	pthread_mutex_unlock(&model->mutex);
+	
+	for (i = 0; i < model->threadCount; i++)
+	{
+		pthread_join(model->threads[i], NULL);
+	}
+	
+	// streams the caller did not free
+	while (model->streams != NULL)
+	{
+		vosk_batch_recognizer_free(model->streams);
+	}
+	
+	// the worker processes are reaped in here, so their CPU time counts below
+	vosk_model_free(model->model);
+	
+	wallSeconds = secondsSince(&model->startTime);
+	cpuTotal = cpuSeconds(RUSAGE_SELF) + cpuSeconds(RUSAGE_CHILDREN);
+	
+	logInfo("Batch throughput: %.3f h of audio in %.3f CPU h (%.1f h audio per CPU h), %.1f s wall clock (%.1fx real-time).\n",
+		model->audioSeconds / 3600.0, cpuTotal / 3600.0,
+		(cpuTotal > 0.0) ? model->audioSeconds / cpuTotal : 0.0,
+		wallSeconds, (wallSeconds > 0.0) ? model->audioSeconds / wallSeconds : 0.0);
+	
+	pthread_cond_destroy(&model->cond);
+	pthread_mutex_destroy(&model->mutex);
+	free(model->threads);
+	free(model);
+}
+
+//////////////////////////////////////////////
+//
+// returns once all queued audio is decoded and all finished streams have their final result
+//
+//////////////////////////////////////////////
+void vosk_batch_model_wait(VoskBatchModel *model)
+{
+	logInfo("vosk_batch_model_wait.\n");
+	
+	pthread_mutex_lock(&model->mutex);
+	
+	for (;;)
+	{
+		VoskBatchRecognizer *stream;
+		int busy = 0;
+		
+		for (stream = model->streams; stream != NULL; stream = stream->next)
+		{
+			if ((stream->pendingChunks > 0) || ((stream->finished != 0) && (stream->done == 0)))
+			{
+				busy = 1;
+				break;
+			}
+		}
+		
+		if ((busy == 0) || (model->threadCount == 0))
+		{
+			break;
+		}
+		
+		pthread_cond_wait(&model->cond, &model->mutex);
+	}
+	
+	logInfo("Batch: %.1f s of audio decoded after %.1f s.\n", model->audioSeconds, secondsSince(&model->startTime));
+	
+	pthread_mutex_unlock(&model->mutex);
+}
+
+//////////////////////////////////////////////
+VoskBatchRecognizer *vosk_batch_recognizer_new(VoskBatchModel *model, float sample_rate)
+{
+	VoskBatchRecognizer *instance;
+	
+	logDebug("vosk_batch_recognizer_new, sample_rate=%.2f.\n", sample_rate);
+	
+	instance = (VoskBatchRecognizer*) calloc(1, sizeof(VoskBatchRecognizer));
+	instance->model = model;
+	instance->sampleRate = sample_rate;
+	instance->recognizer = vosk_recognizer_new(model->model, sample_rate);
+	
+	if (instance->recognizer == NULL)
+	{
+		free(instance);
+		return NULL;
+	}
+	
+	pthread_mutex_lock(&model->mutex);
+	instance->next = model->streams;
+	model->streams = instance;
+	pthread_mutex_unlock(&model->mutex);
+	
+	return instance;
+}
+
+//////////////////////////////////////////////
+void vosk_batch_recognizer_free(VoskBatchRecognizer *recognizer)
+{
+	VoskBatchModel *model = recognizer->model;
+	VoskBatchRecognizer **link;
+	BatchChunk *chunk;
+	
+	logDebug("vosk_batch_recognizer_free.\n");
+	
+	pthread_mutex_lock(&model->mutex);
+	
+	// a thread working on this stream finishes it first
+	recognizer->finished = 1;
+	pthread_cond_broadcast(&model->cond);
+	
+	while (recognizer->served != 0)
+	{
+		pthread_cond_wait(&model->cond, &model->mutex);
+	}
+	
+	for (link = &model->streams; *link != NULL; link = &(*link)->next)
+	{
+		if (*link == recognizer)
+		{
+			*link = recognizer->next;
+			break;
+		}
+	}
+	
+	pthread_cond_broadcast(&model->cond);
+	pthread_mutex_unlock(&model->mutex);
+	
+	while ((chunk = popChunk(recognizer)) != NULL)
+	{
+		free(chunk->data);
+		free(chunk);
+	}
+	
+	while (recognizer->resultsHead != NULL)
+	{
+		vosk_batch_recognizer_pop(recognizer);
+	}
+	
+	if (recognizer->recognizer != NULL)
+	{
+		vosk_recognizer_free(recognizer->recognizer);
+	}
+	
+	free(recognizer);
+}
+
+//////////////////////////////////////////////
+//
+// the data is copied, decoding happens in the background
+//
+//////////////////////////////////////////////
+void vosk_batch_recognizer_accept_waveform(VoskBatchRecognizer *recognizer, const char *data, int length)
+{
+	VoskBatchModel *model = recognizer->model;
+	BatchChunk *chunk = (BatchChunk*) malloc(sizeof(BatchChunk));
+	
+	chunk->data = (char*) malloc(length);
+	chunk->length = length;
+	chunk->next = NULL;
+	memcpy(chunk->data, data, length);
+	
+	pthread_mutex_lock(&model->mutex);
+	
+	if (recognizer->finished != 0)
+	{
+		logError("Batch stream is finished already, dropping %d bytes!\n", length);
+		pthread_mutex_unlock(&model->mutex);
+		free(chunk->data);
+		free(chunk);
+		return;
+	}
+	
+	if (recognizer->chunksTail != NULL)
+	{
+		recognizer->chunksTail->next = chunk;
+	}
+	else
+	{
+		recognizer->chunksHead = chunk;
+	}
+	
+	recognizer->chunksTail = chunk;
+	recognizer->pendingChunks++;
+	
+	pthread_cond_broadcast(&model->cond);
+	pthread_mutex_unlock(&model->mutex);
+}
+
+//////////////////////////////////////////////
+void vosk_batch_recognizer_set_nlsml(VoskBatchRecognizer *recognizer, int nlsml)
+{
+	// stub
+	logDebug("vosk_batch_recognizer_set_nlsml, nlsml=%d.\n", nlsml);
+}
+
+//////////////////////////////////////////////
+void vosk_batch_recognizer_finish_stream(VoskBatchRecognizer *recognizer)
+{
+	pthread_mutex_lock(&recognizer->model->mutex);
+	recognizer->finished = 1;
+	pthread_cond_broadcast(&recognizer->model->cond);
+	pthread_mutex_unlock(&recognizer->model->mutex);
+}
+
+//////////////////////////////////////////////
+//
+// valid until vosk_batch_recognizer_pop(), empty if there is no result (yet)
+//
+//////////////////////////////////////////////
+const char *vosk_batch_recognizer_front_result(VoskBatchRecognizer *recognizer)
+{
+	const char *text = batch_result_empty;
+	
+	pthread_mutex_lock(&recognizer->model->mutex);
+	
+	if (recognizer->resultsHead != NULL)
+	{
+		text = recognizer->resultsHead->text;
+	}
+	
+	pthread_mutex_unlock(&recognizer->model->mutex);
+	
+	return text;
+}
+
+//////////////////////////////////////////////
+void vosk_batch_recognizer_pop(VoskBatchRecognizer *recognizer)
+{
+	BatchResult *result;
+	
+	pthread_mutex_lock(&recognizer->model->mutex);
+	
+	result = recognizer->resultsHead;
+	
+	if (result != NULL)
+	{
+		recognizer->resultsHead = result->next;
+		
+		if (recognizer->resultsHead == NULL)
+		{
+			recognizer->resultsTail = NULL;
+		}
+	}
+	
+	pthread_mutex_unlock(&recognizer->model->mutex);
+	
+	if (result != NULL)
+	{
+		free(result->text);
+		free(result);
+	}
+}
+
+//////////////////////////////////////////////
+int vosk_batch_recognizer_get_pending_chunks(VoskBatchRecognizer *recognizer)
+{
+	int pending;
+	
+	pthread_mutex_lock(&recognizer->model->mutex);
+	pending = recognizer->pendingChunks;
+	pthread_mutex_unlock(&recognizer->model->mutex);
+	
+	return pending;
+}
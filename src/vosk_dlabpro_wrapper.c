@@ -1,47 +1,222 @@
 
 #include "vosk_api.h"
+#include "vosk_dlabpro_wrapper.h"
 
 #include "recognizer_vosk_wrapper.h"
 
+// recognizers patched for it call vosk_dlabpro_notify_state() from there (see waitForRecognizerIdle()),
+// weak so that the wrapper links against the unpatched recognizer as well
+extern "C" void recognizer_set_state_callback(void (*callback)(void)) __attribute__((weak));
+
+#include "json_buffer.h"
+#include "resampler.h"
+#include "voice_filter.h"
+#include "pcm_convert.h"
+#include "sample_ring.h"
+#include "logger.h"
+#include "metrics.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
 #include <assert.h>
-#include <sys/time.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
 
 #include <portaudio.h>
 
+typedef struct WorkerPool WorkerPool;
+
 //////////////////////////////////////////////
 struct VoskModel
 {
-	int       instanceId;
-	pthread_t recognizerThreadId;
+	int         instanceId;
+	WorkerPool *pool;
 };
 
 static int voskModelInstanceId = 1;
 
+//////////////////////////////////////////////
+//
+// one dLabPro recognizer, either the thread in this process,
+// or a forked child process with its own recognizer thread
+// (the recognizer keeps its state in globals, so it cannot
+// be instantiated several times within one process)
+//
+//////////////////////////////////////////////
+typedef struct RecognizerWorker
+{
+	int       workerId;
+	int       inProcess;       // 1 for the recognizer thread of this process
+	pid_t     pid;             // child process otherwise
+	int       socket;          // connection to the child process, -1 if in-process or dead
+	
+	// one request at a time, the text buffer below is protected as well
+	pthread_mutex_t mutex;
+	char     *text;
+	int       textSize;
+	
+	// the session which currently owns this recognizer, protected by workerPoolMutex
+	VoskRecognizer *owner;
+	double          assignedTime;    // the owner got it, metricsTime()
+	
+	// samples waiting in the worker's ring after the last feed
+	int backlog;
+	
+	// state after the last feed, for handing the worker over between two utterances
+	int speaking;          // the VAD is on
+	int resultsPending;    // an utterance ended, its text was not fetched yet
+	int boundaryChecked;   // no handover possible, no need to check again before the next feed
+	
+	// replaced by a reload, its owner moves on at the next utterance boundary, protected by workerPoolMutex
+	int retired;
+} RecognizerWorker;
+
+// number of child processes to fork per pool, 0 runs the recognizer in this process
+static int workerCount = 0;
+
+//////////////////////////////////////////////
+//
+// the workers running one recognizer configuration, shared by all
+// models opened with that configuration
+//
+//////////////////////////////////////////////
+struct WorkerPool
+{
+	char *configPath;
+	char *argv[5];     // for recognizer_main()
+	int   models;      // VoskModel instances using the pool
+	
+	RecognizerWorker *workers;
+	int               count;
+	int               started;
+	
+	// forks the workers of a reload, see startSpawner(), -1 if there is none
+	int   spawner;
+	pid_t spawnerPid;
+	
+	// worker sets replaced by reloads, the processes are gone once their sessions moved on
+	// (the structs stay, sessions may still look at them)
+	RecognizerWorker **retired;
+	int                retiredCount;
+	
+	// the recognizer thread, if it runs in this process
+	pthread_t recognizerThreadId;
+	
+	// sessions without a worker, protected by workerPoolMutex
+	VoskRecognizer *waitingSessions;
+	
+	WorkerPool *next;
+};
+
+// created and destroyed by vosk_model_new() and vosk_model_free() only, before and after the sessions
+static WorkerPool *workerPools = NULL;
+
+// see vosk_dlabpro_reload()
+static int reloadRunning = 0;
+
+static pthread_mutex_t workerPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// broadcast with workerPoolMutex held when a worker may have become free for a waiting session
+static pthread_cond_t workerFreeCond;
+
 //////////////////////////////////////////////
 struct VoskRecognizer
 {
 	int instanceId;
 	int modelInstanceId;
 	float inputSampleRate;
+	
+	WorkerPool       *pool;
+	RecognizerWorker *worker;
+	
+	// audio converted to float at the input rate
+	float *input;
+	int    inputSize;
+	
+	// odd byte at the end of the last chunk, it is the first half of the next sample
+	unsigned char pendingByte;
+	int           hasPendingByte;
+	
+	// and resampled to 16kHz before handing it to the worker
+	Resampler resampler;
+	float *samples;
+	int    samplesSize;
+	
+	// without long silence
+	VoiceFilter voiceFilter;
+	float *voiced;
+	int    voicedSize;
+	
+	// the resulting JSON strings, valid until the next call for this instance
+	JsonBuffer result;
+	
+	// the last partial result handed out, built again only when the text changed
+	JsonBuffer partial;
+	char      *partialText;
+	int        partialTextSize;
+	double     partialTime;
+	
+	// 16kHz audio waiting for a worker, only while the instance has none
+	float *queued;
+	int    queuedCount;
+	int    queuedSize;
+	float  queuedPeak;     // loudest chunk (RMS) in the queue
+	
+	// scheduling, protected by workerPoolMutex
+	int             waiting;
+	double          waitingSince;
+	double          receivedTime;   // the last audio for this instance arrived, see vosk_dlabpro_audio_received()
+	int             finalWaiting;   // the final result waits for a worker
+	double          finalSince;     // since then, 0.0 if not
+	double          waitSeconds;    // in total, for the statistics
+	int             waitTurns;
+	VoskRecognizer *nextWaiting;
+	
+	// texts of the utterance ended when the worker went to another session, handed
+	// out with the next result, protected by workerPoolMutex (see flushOwner())
+	char *heldText;
+	int   heldTextSize;
 };
 
 static int voskRecognizerInstanceId = 1;
 
+// the only rate the dlabpro recognizer accepts
+#define RECOGNIZER_SAMPLE_RATE 16000
+
+// silence filter of new instances, see vosk_dlabpro_set_voice_filter()
+static int   voiceFilterEnabled     = 1;
+static float voiceFilterThresholdDb = -50.0f;
+static int   voiceFilterHangoverMs  = 1000;
+static int   voiceFilterPrerollMs   = 300;
+
+// see vosk_dlabpro_set_partial_interval()
+static double partialInterval = 0.0;
+
 //////////////////////////////////////////////
 //
-// start dlabpro recognizer from here with these args
+// start dlabpro recognizer from here with the args of the pool
 //
 //////////////////////////////////////////////
-static char* recognizer_argv[] = {"", "-cfg", "recognizer.cfg", "-out", "vad"};  
-
 static void* recognizerThread(void* arg)
 {
-	recognizer_main((sizeof(recognizer_argv) / sizeof(char*)), ((char**) &recognizer_argv));
+	WorkerPool *pool = (WorkerPool*) arg;
+	
+	if (recognizer_set_state_callback != NULL)
+	{
+		recognizer_set_state_callback(vosk_dlabpro_notify_state);
+	}
+	
+	recognizer_main((sizeof(pool->argv) / sizeof(char*)), pool->argv);
 	
 	return (void *) NULL;
 }
@@ -64,408 +239,3189 @@ static int audioDecodingStatus = 0;
 
 ///////////////////////////////////////////////
 //
-// buffer for feeding the portaudio callback
+// signalling of busy/idle transitions of the recognizer thread
+//
+//////////////////////////////////////////////
+
+// upper limit for waiting on one transition, the recognizer is considered stuck afterwards
+#define RECOGNIZER_STATE_TIMEOUT_MS 5000
+
+// the recognizer calls vosk_dlabpro_notify_state() on every transition if it has
+// recognizer_set_state_callback(); polling is only the fallback for the ones without it:
+// the counters are checked once the block should be done by the time the shortest recent
+// blocks took, then every millisecond
+#define RECOGNIZER_STATE_POLL_MS 1
+
+static pthread_mutex_t recognizerStateMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  recognizerStateCond;
+static pthread_cond_t  feederCond;
+static pthread_once_t  recognizerStateOnce = PTHREAD_ONCE_INIT;
+static int             recognizerNotifiesState = 0;
+static double          recognizerBlockSeconds  = 0.0;  // recent time of a block, only used by the feeder
+
+static void initRecognizerState(void)
+{
+	pthread_condattr_t attr;
+	
+	// timeouts are computed on the monotonic clock, so wall clock jumps do not matter
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&recognizerStateCond, &attr);
+	pthread_cond_init(&feederCond, &attr);
+	pthread_cond_init(&workerFreeCond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static void addMilliseconds(struct timespec *ts, int ms)
+{
+	ts->tv_sec  += ms / 1000;
+	ts->tv_nsec += (long) (ms % 1000) * 1000000L;
+	
+	if (ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static int deadlineReached(const struct timespec *deadline)
+{
+	struct timespec now;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (now.tv_sec > deadline->tv_sec) || ((now.tv_sec == deadline->tv_sec) && (now.tv_nsec >= deadline->tv_nsec));
+}
+
+void vosk_dlabpro_notify_state(void)
+{
+	pthread_once(&recognizerStateOnce, initRecognizerState);
+	
+	pthread_mutex_lock(&recognizerStateMutex);
+	recognizerNotifiesState = 1;
+	pthread_cond_broadcast(&recognizerStateCond);
+	pthread_mutex_unlock(&recognizerStateMutex);
+}
+
+///////////////////////////////////////////////
+//
+// the recognizer went busy at least once since the counters were sampled,
+// and went idle again as often as it went busy
+//
+//////////////////////////////////////////////
+static int recognizerFinished(int busyCtr, int idleCtr)
+{
+	int busyDelta = recognizer_get_busy_counter() - busyCtr;
+	int idleDelta = recognizer_get_idle_counter() - idleCtr;
+	
+	return (busyDelta > 0) && (idleDelta >= busyDelta);
+}
+
+///////////////////////////////////////////////
+//
+// block until the recognizer has processed everything fed after sampling the counters
+//
+// returns 1 when done, 0 if the recognizer did not finish in time
+//
+//////////////////////////////////////////////
+static int waitForRecognizerIdle(int busyCtr, int idleCtr)
+{
+	struct timespec deadline;
+	int finished = 1;
+	int predicted = 0;    // the first check is at the expected end of the block
+	double start = metricsTime();
+	
+	pthread_once(&recognizerStateOnce, initRecognizerState);
+	
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	addMilliseconds(&deadline, RECOGNIZER_STATE_TIMEOUT_MS);
+	
+	pthread_mutex_lock(&recognizerStateMutex);
+	
+	// the counters are checked with the mutex held, and the recognizer needs the mutex
+	// to signal, so a transition cannot slip in between check and wait
+	while (recognizerFinished(busyCtr, idleCtr) == 0)
+	{
+		struct timespec wakeup = deadline;
+		
+		if (recognizerNotifiesState == 0)
+		{
+			int waitMs = RECOGNIZER_STATE_POLL_MS;
+			
+			if (predicted == 0)
+			{
+				waitMs = (int) (recognizerBlockSeconds * 1000.0 - (metricsTime() - start) * 1000.0);
+				predicted = 1;
+			}
+			
+			clock_gettime(CLOCK_MONOTONIC, &wakeup);
+			addMilliseconds(&wakeup, (waitMs > RECOGNIZER_STATE_POLL_MS) ? waitMs : RECOGNIZER_STATE_POLL_MS);
+		}
+		
+		if ((pthread_cond_timedwait(&recognizerStateCond, &recognizerStateMutex, &wakeup) == ETIMEDOUT) && (deadlineReached(&deadline) != 0))
+		{
+			finished = recognizerFinished(busyCtr, idleCtr);
+			break;
+		}
+	}
+	
+	pthread_mutex_unlock(&recognizerStateMutex);
+	
+	if (finished != 0)
+	{
+		double elapsed = metricsTime() - start;
+		
+		// follows shorter blocks right away, so a fast block is not waited for too long
+		recognizerBlockSeconds = ((recognizerBlockSeconds == 0.0) || (elapsed < recognizerBlockSeconds)) ?
+			elapsed : 0.9 * recognizerBlockSeconds + 0.1 * elapsed;
+	}
+	
+	return finished;
+}
+
+///////////////////////////////////////////////
+//
+// audio path within the process running the recognizer: callers push 16kHz samples
+// into a ring, the feeder thread hands them to the portaudio callback block by block
 //
 //////////////////////////////////////////////
+
+// about 10 seconds of audio, network bursts do not block the caller
+#define FEEDER_RING_SAMPLES (10 * RECOGNIZER_SAMPLE_RATE)
+
+// re-check interval of a waiting producer or feeder, a lost wakeup costs no more than this
+#define FEEDER_POLL_MS      10
+
+static SampleRing      feederRing;
+static pthread_t       feederThreadId;
+static int             feederExit = 0;
+static int             feederBusy = 0;          // a block is being decoded
+static int             feederSleeping = 0;      // the feeder waits for samples
+static int             producerSleeping = 0;    // a caller waits for space or for the ring to drain
+static pthread_mutex_t feederMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// buffer for feeding the portaudio callback
 static float audioCallbackBuffer[PABUF_SIZE];
-static int audioCallbackBufferPtr = 0;
+
+// results as of the last decoded block (the recognizer changes its own buffers while decoding)
+static pthread_mutex_t recognizerTextMutex = PTHREAD_MUTEX_INITIALIZER;
+static char *partialText = NULL;
+static int   partialTextSize = 0;
+static int   partialTextValid = 0;    // 0 if VAD is off
+
+// one 0-terminated text per utterance, queued until somebody fetches it
+static char *finalTexts = NULL;
+static int   finalTextsSize = 0;
+static int   finalTextsLength = 0;
+static int   finalTextsCount = 0;
+
+static void storeText(char **buffer, int *size, const char *text, int append)
+{
+	int offset = ((append != 0) && (*buffer != NULL)) ? strlen(*buffer) : 0;
+	int length = strlen(text);
+	
+	// appended texts are separated by a blank
+	int separator = (offset > 0) ? 1 : 0;
+	
+	if (offset + separator + length + 1 > *size)
+	{
+		*size = offset + separator + length + 1;
+		*buffer = (char*) realloc(*buffer, *size);
+	}
+	
+	if (separator != 0)
+	{
+		(*buffer)[offset] = ' ';
+	}
+	
+	memcpy(*buffer + offset + separator, text, length + 1);
+}
+
+///////////////////////////////////////////////
+//
+// sleep/wakeup between producer and feeder, the ring itself needs no lock
+//
+// the sleeping side publishes its flag before checking its condition, the waking side
+// updates the ring before checking the flag, so one of both sees the other
+//
+//////////////////////////////////////////////
+static void feederWait(int *sleeping, int (*ready)(void))
+{
+	struct timespec wakeup;
+	
+	pthread_mutex_lock(&feederMutex);
+	
+	__atomic_store_n(sleeping, 1, __ATOMIC_SEQ_CST);
+	
+	if (ready() == 0)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &wakeup);
+		addMilliseconds(&wakeup, FEEDER_POLL_MS);
+		pthread_cond_timedwait(&feederCond, &feederMutex, &wakeup);
+	}
+	
+	__atomic_store_n(sleeping, 0, __ATOMIC_RELAXED);
+	
+	pthread_mutex_unlock(&feederMutex);
+}
+
+static void feederWake(int *sleeping)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	
+	if (__atomic_load_n(sleeping, __ATOMIC_RELAXED) != 0)
+	{
+		pthread_mutex_lock(&feederMutex);
+		pthread_cond_broadcast(&feederCond);
+		pthread_mutex_unlock(&feederMutex);
+	}
+}
+
+static int blockAvailable(void)
+{
+	return (sampleRingFill(&feederRing) >= PABUF_SIZE) || (__atomic_load_n(&feederExit, __ATOMIC_SEQ_CST) != 0);
+}
+
+static int spaceAvailable(void)
+{
+	return sampleRingFill(&feederRing) < sampleRingCapacity(&feederRing);
+}
+
+// everything except the last incomplete block is decoded
+// (the fill is checked first, the feeder marks itself busy before taking a block)
+static int feederDrained(void)
+{
+	return (sampleRingFill(&feederRing) < PABUF_SIZE) && (__atomic_load_n(&feederBusy, __ATOMIC_SEQ_CST) == 0);
+}
+
+///////////////////////////////////////////////
+//
+// decide whether to announce a "final" result, called while the recognizer is idle
+//
+//////////////////////////////////////////////
+static void updateResults(void)
+{
+	pthread_mutex_lock(&recognizerTextMutex);
+	
+	if (recognizer_get_vad_status() == 1)
+	{
+		logDebug("O ");
+		
+		// we always need more data if VAD is active
+		storeText(&partialText, &partialTextSize, recognizer_partial_result(), 0);
+		partialTextValid = 1;
+		__atomic_store_n(&audioDecodingStatus, 1, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		partialTextValid = 0;
+		
+		// check if VAD was active before, if yes, we have a result
+		if (audioDecodingStatus == 1)
+		{
+			const char *text = recognizer_final_result();
+			int length = strlen(text);
+			
+			if (finalTextsLength + length + 1 > finalTextsSize)
+			{
+				finalTextsSize = finalTextsLength + length + 1;
+				finalTexts = (char*) realloc(finalTexts, finalTextsSize);
+			}
+			
+			memcpy(finalTexts + finalTextsLength, text, length + 1);
+			finalTextsLength += length + 1;
+			__atomic_store_n(&finalTextsCount, finalTextsCount + 1, __ATOMIC_RELEASE);
+			
+			recognizer_flush_results();
+		}
+		
+		__atomic_store_n(&audioDecodingStatus, 0, __ATOMIC_RELAXED);
+	}
+	
+	pthread_mutex_unlock(&recognizerTextMutex);
+}
+
+static void* feederThread(void* arg)
+{
+	int online = 0;
+	
+	while (__atomic_load_n(&feederExit, __ATOMIC_ACQUIRE) == 0)
+	{
+		int idleCtr, busyCtr;
+		double start, elapsed;
+		
+		// the callback is there once the recognizer went idle for the first time,
+		// audio arriving earlier waits in the ring
+		if (online == 0)
+		{
+			online = (recognizer_get_idle_counter() != 0);
+			
+			if (online == 0)
+			{
+				usleep(FEEDER_POLL_MS * 1000);
+				continue;
+			}
+		}
+		
+		if (sampleRingFill(&feederRing) < PABUF_SIZE)
+		{
+			feederWait(&feederSleeping, blockAvailable);
+			continue;
+		}
+		
+		__atomic_store_n(&feederBusy, 1, __ATOMIC_SEQ_CST);
+		
+		sampleRingRead(&feederRing, audioCallbackBuffer, PABUF_SIZE);
+		feederWake(&producerSleeping);
+		
+		idleCtr = recognizer_get_idle_counter();
+		busyCtr = recognizer_get_busy_counter();
+		start = metricsTime();
+		metricsGaugeAdd(METRIC_RECOGNIZERS_BUSY, 1);
+		
+		// emulate portaudio callback
+		audioStreamCallback(audioCallbackBuffer, NULL, PABUF_SIZE, NULL, 0, audioStreamUserData);
+		
+		// the next block must not overtake this one, so wait for the recognizer to become busy first and then idle again
+		if (waitForRecognizerIdle(busyCtr, idleCtr) == 0)
+		{
+			logError("Recognizer did not finish decoding within %d ms!\n", RECOGNIZER_STATE_TIMEOUT_MS);
+		}
+		
+		metricsGaugeAdd(METRIC_RECOGNIZERS_BUSY, -1);
+		elapsed = metricsTime() - start;
+		metricsObserve(METRIC_BLOCK_DECODE_SECONDS, elapsed);
+		metricsAdd(METRIC_DECODE_MICROSECONDS, (long long) (elapsed * 1e6));
+		metricsAdd(METRIC_AUDIO_SAMPLES, PABUF_SIZE);
+		
+		updateResults();
+		
+		__atomic_store_n(&feederBusy, 0, __ATOMIC_SEQ_CST);
+		feederWake(&producerSleeping);
+	}
+	
+	return (void *) NULL;
+}
+
+///////////////////////////////////////////////
+//
+// to be started right after the recognizer thread, in the process running it
+//
+//////////////////////////////////////////////
+static void startFeeder(void)
+{
+	int retVal;
+	
+	pthread_once(&recognizerStateOnce, initRecognizerState);
+	
+	if (sampleRingInit(&feederRing, FEEDER_RING_SAMPLES) == 0)
+	{
+		logError("Cannot allocate the recognizer ring!\n");
+		exit(EXIT_FAILURE);
+	}
+	
+	feederExit = 0;
+	
+	retVal = pthread_create(&feederThreadId,
+		NULL,
+		feederThread,
+		NULL);
+	
+	if (retVal != 0)
+	{
+		logError("feeder thread start error: %d.\n", retVal);
+	}
+}
+
+static void stopFeeder(void)
+{
+	__atomic_store_n(&feederExit, 1, __ATOMIC_RELEASE);
+	feederWake(&feederSleeping);
+	
+	pthread_join(feederThreadId, NULL);
+	
+	sampleRingFree(&feederRing);
+}
 
 ///////////////////////////////////////////////
 //
-// buffer for the resulting JSON strings
+// feed 16kHz float samples to the recognizer running in this process,
+// blocks only if the ring is full
+//
+// returns 1 if the VAD went off for an utterance not fetched yet (so there is a result), 0 if decoding continues
 //
 //////////////////////////////////////////////
-static char resultBuffer[5000];
+static int localFeed(const float *samples, int count)
+{
+	int written = 0;
+	
+	while (written < count)
+	{
+		int stored = sampleRingWrite(&feederRing, samples + written, count - written);
+		
+		if (stored > 0)
+		{
+			written += stored;
+			feederWake(&feederSleeping);
+		}
+		else
+		{
+			logInfo("Recognizer backlog full (%d ms), waiting.\n", sampleRingFill(&feederRing) * 1000 / RECOGNIZER_SAMPLE_RATE);
+			feederWait(&producerSleeping, spaceAvailable);
+		}
+	}
+	
+	return (__atomic_load_n(&finalTextsCount, __ATOMIC_ACQUIRE) > 0) ? 1 : 0;
+}
+
+// samples waiting to be decoded
+static int localBacklog(void)
+{
+	return sampleRingFill(&feederRing);
+}
+
+// 1 while an utterance is going on, as of the last decoded block
+static int localSpeaking(void)
+{
+	return __atomic_load_n(&audioDecodingStatus, __ATOMIC_RELAXED);
+}
+
+// wait until the ring is decoded (unless the recognizer never came online)
+static void drainFeeder(void)
+{
+	if (recognizer_get_idle_counter() != 0)
+	{
+		while (feederDrained() == 0)
+		{
+			feederWait(&producerSleeping, feederDrained);
+		}
+	}
+}
+
+///////////////////////////////////////////////
+//
+// decode the ring, returns 1 if the recognizer is between two utterances
+// then and all texts were fetched, so it may serve another session
+//
+//////////////////////////////////////////////
+static int localDrain(void)
+{
+	drainFeeder();
+	
+	return (localSpeaking() == 0) && (__atomic_load_n(&finalTextsCount, __ATOMIC_ACQUIRE) == 0);
+}
+
+///////////////////////////////////////////////
+//
+// partial text of the recognizer in this process, copied to buffer, returns 0 if VAD is off
+//
+//////////////////////////////////////////////
+static int localPartialText(char **buffer, int *size)
+{
+	int valid;
+	
+	pthread_mutex_lock(&recognizerTextMutex);
+	
+	valid = partialTextValid;
+	
+	if (valid != 0)
+	{
+		storeText(buffer, size, partialText, 0);
+	}
+	
+	pthread_mutex_unlock(&recognizerTextMutex);
+	
+	return valid;
+}
+
+///////////////////////////////////////////////
+//
+// text of the oldest utterance not fetched yet, copied to buffer
+//
+// with drain set, the audio still in the ring is decoded first and
+// all remaining utterances are returned at once (end of stream)
+//
+//////////////////////////////////////////////
+static void localFinalText(char **buffer, int *size, int drain)
+{
+	if (drain != 0)
+	{
+		drainFeeder();
+	}
+	
+	pthread_mutex_lock(&recognizerTextMutex);
+	
+	storeText(buffer, size, "", 0);
+	
+	while (finalTextsCount > 0)
+	{
+		int length = strlen(finalTexts) + 1;
+		
+		storeText(buffer, size, finalTexts, 1);
+		
+		memmove(finalTexts, finalTexts + length, finalTextsLength - length);
+		finalTextsLength -= length;
+		__atomic_store_n(&finalTextsCount, finalTextsCount - 1, __ATOMIC_RELEASE);
+		
+		if (drain == 0)
+		{
+			break;
+		}
+	}
+	
+	pthread_mutex_unlock(&recognizerTextMutex);
+}
+
+///////////////////////////////////////////////
+//
+// warm-up of the recognizer in this process: wait for it to come online, then decode
+// synthetic audio to fault in the model and the decoder's memory, and discard the results
+//
+// returns 1 if the recognizer came online within timeoutMs
+//
+//////////////////////////////////////////////
+
+// a voice-like signal of this fundamental frequency, and silence afterwards to end the utterance
+#define WARMUP_PITCH_HZ    150
+#define WARMUP_SILENCE_MS  1000
+
+static int localWarmUp(int warmUpMs, int timeoutMs)
+{
+	float block[PABUF_SIZE];
+	int voiced = warmUpMs * (RECOGNIZER_SAMPLE_RATE / 1000);
+	int total = voiced + WARMUP_SILENCE_MS * (RECOGNIZER_SAMPLE_RATE / 1000);
+	int waited = 0;
+	int n, i, k;
+	char *text = NULL;
+	int textSize = 0;
+	
+	while (recognizer_get_idle_counter() == 0)
+	{
+		if (waited >= timeoutMs)
+		{
+			logError("Recognizer not online within %d ms!\n", timeoutMs);
+			return 0;
+		}
+		
+		usleep(FEEDER_POLL_MS * 1000);
+		waited += FEEDER_POLL_MS;
+	}
+	
+	if (warmUpMs <= 0)
+	{
+		return 1;
+	}
+	
+	// a few harmonics, amplitude modulated at a syllable rate
+	for (n = 0; n < total; n += PABUF_SIZE)
+	{
+		for (i = 0; i < PABUF_SIZE; i++)
+		{
+			double t = (double) (n + i) / RECOGNIZER_SAMPLE_RATE;
+			double sample = 0.0;
+			
+			if (n + i < voiced)
+			{
+				for (k = 1; k <= 5; k++)
+				{
+					sample += sin(2.0 * M_PI * WARMUP_PITCH_HZ * k * t) / k;
+				}
+				
+				sample *= 0.1 * (1.0 + sin(2.0 * M_PI * 4.0 * t)) / 2.0;
+			}
+			
+			block[i] = (float) sample;
+		}
+		
+		localFeed(block, PABUF_SIZE);
+	}
+	
+	// nothing of it must reach the first session
+	localFinalText(&text, &textSize, 1);
+	free(text);
+	
+	if (localSpeaking() != 0)
+	{
+		logInfo("Recognizer still in an utterance after the warm-up.\n");
+	}
+	
+	logInfo("Recognizer warmed up with %d ms of audio after %d ms waiting for it.\n", warmUpMs, waited);
+	
+	return 1;
+}
+
+///////////////////////////////////////////////
+//
+// requests from the server process to a worker process,
+// every request is answered with a message of the same type
+//
+//////////////////////////////////////////////
+#define WORKER_FEED    1    // payload: 16kHz float samples, reply status: see localFeed(), reply payload: WorkerFeedState
+#define WORKER_PARTIAL 2    // reply payload: partial text, reply status: 0 if VAD is off
+#define WORKER_RESULT  3    // reply payload: final text collected since the last request
+#define WORKER_FINAL   4    // like WORKER_RESULT, but the audio queued in the worker is decoded first
+#define WORKER_DRAIN   5    // decode the audio queued in the worker, reply status: see localDrain()
+#define WORKER_WARMUP  6    // payload: WorkerWarmUp, reply status: see localWarmUp()
+
+typedef struct WorkerWarmUp
+{
+	int warmUpMs;
+	int timeoutMs;
+} WorkerWarmUp;
+
+typedef struct WorkerFeedState
+{
+	int backlog;     // samples in the ring
+	int speaking;    // see localSpeaking()
+} WorkerFeedState;
+
+typedef struct WorkerMessage
+{
+	int type;
+	int status;
+	int length;    // bytes of payload following this header
+} WorkerMessage;
+
+static int writeFully(int fd, const void *data, int length)
+{
+	const char *ptr = (const char*) data;
+	
+	while (length > 0)
+	{
+		// a dead peer must not kill us with SIGPIPE
+		ssize_t written = send(fd, ptr, length, MSG_NOSIGNAL);
+		
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			
+			return 0;
+		}
+		
+		ptr    += written;
+		length -= written;
+	}
+	
+	return 1;
+}
+
+static int readFully(int fd, void *data, int length)
+{
+	char *ptr = (char*) data;
+	
+	while (length > 0)
+	{
+		ssize_t received = recv(fd, ptr, length, 0);
+		
+		if ((received < 0) && (errno == EINTR))
+		{
+			continue;
+		}
+		
+		if (received <= 0)
+		{
+			return 0;
+		}
+		
+		ptr    += received;
+		length -= received;
+	}
+	
+	return 1;
+}
+
+static int sendMessage(int fd, int type, int status, const void *payload, int length)
+{
+	WorkerMessage message;
+	
+	message.type   = type;
+	message.status = status;
+	message.length = length;
+	
+	return (writeFully(fd, &message, sizeof(message)) != 0) && ((length == 0) || (writeFully(fd, payload, length) != 0));
+}
+
+///////////////////////////////////////////////
+//
+// the payload ends up 0-terminated in a buffer which grows as needed
+//
+//////////////////////////////////////////////
+static int receiveMessage(int fd, WorkerMessage *message, char **payload, int *payloadSize)
+{
+	if ((readFully(fd, message, sizeof(WorkerMessage)) == 0) || (message->length < 0))
+	{
+		return 0;
+	}
+	
+	if (message->length + 1 > *payloadSize)
+	{
+		char *grown = (char*) realloc(*payload, message->length + 1);
+		
+		if (grown == NULL)
+		{
+			return 0;
+		}
+		
+		*payload     = grown;
+		*payloadSize = message->length + 1;
+	}
+	
+	if (readFully(fd, *payload, message->length) == 0)
+	{
+		return 0;
+	}
+	
+	(*payload)[message->length] = 0;
+	
+	return 1;
+}
+
+///////////////////////////////////////////////
+//
+// main loop of a forked worker process: run the recognizer and
+// serve requests until the server closes the connection
+//
+//////////////////////////////////////////////
+static void workerProcess(WorkerPool *pool, int fd)
+{
+	pthread_t recognizerThreadId;
+	WorkerMessage request;
+	char *payload = NULL;
+	int payloadSize = 0;
+	char *text = NULL;
+	int textSize = 0;
+	
+	int retVal = pthread_create(&recognizerThreadId,
+		NULL,
+		recognizerThread,
+		pool);
+	
+	if (retVal != 0)
+	{
+		logError("recognizer thread start error: %d.\n", retVal);
+		logFlush();
+		_exit(EXIT_FAILURE);
+	}
+	
+	startFeeder();
+	
+	while (receiveMessage(fd, &request, &payload, &payloadSize) != 0)
+	{
+		int replied = 0;
+		int status;
+		WorkerFeedState state;
+		
+		switch (request.type)
+		{
+			case WORKER_FEED:
+				status = localFeed((const float*) payload, request.length / sizeof(float));
+				state.backlog  = localBacklog();
+				state.speaking = localSpeaking();
+				replied = sendMessage(fd, WORKER_FEED, status, &state, sizeof(state));
+				break;
+			
+			case WORKER_DRAIN:
+				replied = sendMessage(fd, WORKER_DRAIN, localDrain(), NULL, 0);
+				break;
+			
+			case WORKER_WARMUP:
+				status = 0;
+				
+				if (request.length == sizeof(WorkerWarmUp))
+				{
+					WorkerWarmUp warmUp;
+					
+					memcpy(&warmUp, payload, sizeof(warmUp));
+					status = localWarmUp(warmUp.warmUpMs, warmUp.timeoutMs);
+				}
+				
+				replied = sendMessage(fd, WORKER_WARMUP, status, NULL, 0);
+				break;
+			
+			case WORKER_PARTIAL:
+				status = localPartialText(&text, &textSize);
+				replied = sendMessage(fd, WORKER_PARTIAL, status, text, (status != 0) ? strlen(text) : 0);
+				break;
+			
+			case WORKER_RESULT:
+			case WORKER_FINAL:
+				localFinalText(&text, &textSize, (request.type == WORKER_FINAL));
+				replied = sendMessage(fd, request.type, 1, text, strlen(text));
+				break;
+			
+			default:
+				logError("Worker received unknown request %d!\n", request.type);
+				break;
+		}
+		
+		if (replied == 0)
+		{
+			break;
+		}
+	}
+	
+	// same shutdown as vosk_model_free() does for the in-process recognizer
+	stopFeeder();
+	recognizer_exit();
+	pthread_join(recognizerThreadId, NULL);
+	
+	free(payload);
+	free(text);
+	close(fd);
+	
+	// no atexit() handlers with _exit()
+	logFlush();
+	
+	_exit(EXIT_SUCCESS);
+}
+
+///////////////////////////////////////////////
+//
+// a worker process vanished, its sessions will be rejected from now on
+//
+//////////////////////////////////////////////
+static void workerLost(RecognizerWorker *worker)
+{
+	logError("Lost connection to recognizer worker %d (pid %d)!\n", worker->workerId, (int) worker->pid);
+	
+	close(worker->socket);
+	worker->socket = -1;
+	
+	worker->backlog = 0;
+	metricsSetBacklog(worker->workerId, 0);
+	
+	waitpid(worker->pid, NULL, WNOHANG);
+}
+
+static int workerAlive(RecognizerWorker *worker)
+{
+	return (worker->inProcess != 0) || (worker->socket >= 0);
+}
+
+///////////////////////////////////////////////
+//
+// the worker functions below must be called with worker->mutex held
+//
+//////////////////////////////////////////////
+static void workerSetBacklog(RecognizerWorker *worker, int backlog)
+{
+	worker->backlog = backlog;
+	metricsSetBacklog(worker->workerId, backlog);
+}
+
+static void workerFeedState(RecognizerWorker *worker, int status, int backlog, int speaking)
+{
+	workerSetBacklog(worker, backlog);
+	
+	// read by the scheduler without worker->mutex
+	__atomic_store_n(&worker->speaking, speaking, __ATOMIC_RELAXED);
+	__atomic_store_n(&worker->resultsPending, status, __ATOMIC_RELAXED);
+	__atomic_store_n(&worker->boundaryChecked, 0, __ATOMIC_RELAXED);
+	
+	// a waiting session may take it over now (without workerPoolMutex, the waiters check again in a while anyway)
+	if (speaking == 0)
+	{
+		pthread_cond_broadcast(&workerFreeCond);
+	}
+}
+
+static int workerFeed(RecognizerWorker *worker, const float *samples, int count)
+{
+	WorkerMessage reply;
+	
+	if (worker->inProcess != 0)
+	{
+		int retVal = localFeed(samples, count);
+		
+		workerFeedState(worker, retVal, localBacklog(), localSpeaking());
+		
+		return retVal;
+	}
+	
+	if (worker->socket < 0)
+	{
+		logError("IGNORE (worker %d is gone)\n", worker->workerId);
+		metricsAdd(METRIC_CHUNKS_IGNORED, 1);
+		return 0;
+	}
+	
+	if ((sendMessage(worker->socket, WORKER_FEED, 0, samples, count * sizeof(float)) != 0) &&
+		(receiveMessage(worker->socket, &reply, &worker->text, &worker->textSize) != 0))
+	{
+		if (reply.length == sizeof(WorkerFeedState))
+		{
+			WorkerFeedState state;
+			
+			memcpy(&state, worker->text, sizeof(state));
+			workerFeedState(worker, reply.status, state.backlog, state.speaking);
+		}
+		
+		return reply.status;
+	}
+	
+	workerLost(worker);
+	
+	return 0;
+}
+
+// see localDrain(), 0 if the worker is gone
+static int workerDrain(RecognizerWorker *worker)
+{
+	WorkerMessage reply;
+	
+	if (worker->inProcess != 0)
+	{
+		int boundary = localDrain();
+		
+		workerSetBacklog(worker, 0);
+		
+		return boundary;
+	}
+	
+	if (worker->socket < 0)
+	{
+		return 0;
+	}
+	
+	// the worker decoded all it had, boundary or not
+	if ((sendMessage(worker->socket, WORKER_DRAIN, 0, NULL, 0) != 0) &&
+		(receiveMessage(worker->socket, &reply, &worker->text, &worker->textSize) != 0))
+	{
+		workerSetBacklog(worker, 0);
+		return reply.status;
+	}
+	
+	workerLost(worker);
+	
+	return 0;
+}
+
+///////////////////////////////////////////////
+//
+// partial (WORKER_PARTIAL) or final (WORKER_RESULT, WORKER_FINAL) text of a worker,
+// NULL if there is none, valid until worker->mutex is released
+//
+//////////////////////////////////////////////
+static const char *workerText(RecognizerWorker *worker, int type)
+{
+	WorkerMessage reply;
+	
+	if (worker->inProcess != 0)
+	{
+		if (type == WORKER_PARTIAL)
+		{
+			return (localPartialText(&worker->text, &worker->textSize) != 0) ? worker->text : NULL;
+		}
+		
+		localFinalText(&worker->text, &worker->textSize, (type == WORKER_FINAL));
+		
+		if (type == WORKER_FINAL)
+		{
+			workerSetBacklog(worker, 0);
+		}
+		
+		return worker->text;
+	}
+	
+	if (worker->socket < 0)
+	{
+		return NULL;
+	}
+	
+	// WORKER_FINAL drains the worker first
+	if ((sendMessage(worker->socket, type, 0, NULL, 0) != 0) &&
+		(receiveMessage(worker->socket, &reply, &worker->text, &worker->textSize) != 0))
+	{
+		if (type == WORKER_FINAL)
+		{
+			workerSetBacklog(worker, 0);
+		}
+		
+		return (reply.status != 0) ? worker->text : NULL;
+	}
+	
+	workerLost(worker);
+	
+	return NULL;
+}
+
+///////////////////////////////////////////////
+//
+// worker ids are unique among the running workers, for the metrics
+// (the ids of retired workers are used again)
+//
+//////////////////////////////////////////////
+static int workerIdUsed(int workerId)
+{
+	WorkerPool *pool;
+	int i, j;
+	
+	for (pool = workerPools; pool != NULL; pool = pool->next)
+	{
+		for (i = 0; i < pool->count; i++)
+		{
+			if ((pool->workers != NULL) && (pool->workers[i].workerId == workerId))
+			{
+				return 1;
+			}
+			
+			for (j = 0; j < pool->retiredCount; j++)
+			{
+				if ((pool->retired[j][i].workerId == workerId) && (workerAlive(&pool->retired[j][i]) != 0))
+				{
+					return 1;
+				}
+			}
+		}
+	}
+	
+	return 0;
+}
+
+static int newWorkerId(RecognizerWorker *workers, int count)
+{
+	int workerId = 1;
+	int i;
+	
+	for (;;)
+	{
+		int taken = workerIdUsed(workerId);
+		
+		for (i = 0; i < count; i++)
+		{
+			taken |= (workers[i].workerId == workerId);
+		}
+		
+		if (taken == 0)
+		{
+			return workerId;
+		}
+		
+		workerId++;
+	}
+}
+
+///////////////////////////////////////////////
+//
+// a worker forked by a reload inherits the server's sockets (listener, clients),
+// which must not stay open in the worker
+//
+//////////////////////////////////////////////
+static void closeInheritedFiles(int keep)
+{
+	DIR *dir = opendir("/proc/self/fd");
+	struct dirent *entry;
+	int fd;
+	
+	if (dir == NULL)
+	{
+		for (fd = 3; fd < sysconf(_SC_OPEN_MAX); fd++)
+		{
+			if (fd != keep)
+			{
+				close(fd);
+			}
+		}
+		
+		return;
+	}
+	
+	while ((entry = readdir(dir)) != NULL)
+	{
+		fd = atoi(entry->d_name);
+		
+		if ((fd > 2) && (fd != keep) && (fd != dirfd(dir)))
+		{
+			close(fd);
+		}
+	}
+	
+	closedir(dir);
+}
+
+///////////////////////////////////////////////
+//
+// fork one worker process, from this process while it has no threads yet,
+// later on (reloads) by the spawner of the pool
+//
+//////////////////////////////////////////////
+static int sendSocket(int fd, int socket, pid_t pid)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr message;
+	struct iovec data;
+	
+	memset(&message, 0, sizeof(message));
+	memset(control, 0, sizeof(control));
+	
+	data.iov_base = &pid;
+	data.iov_len  = sizeof(pid);
+	message.msg_iov    = &data;
+	message.msg_iovlen = 1;
+	
+	if (socket >= 0)
+	{
+		struct cmsghdr *header;
+		
+		message.msg_control    = control;
+		message.msg_controllen = sizeof(control);
+		
+		header = CMSG_FIRSTHDR(&message);
+		header->cmsg_level = SOL_SOCKET;
+		header->cmsg_type  = SCM_RIGHTS;
+		header->cmsg_len   = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(header), &socket, sizeof(int));
+	}
+	
+	return (sendmsg(fd, &message, MSG_NOSIGNAL) == sizeof(pid));
+}
+
+// returns the connection to the worker, -1 if the spawner could not fork or is gone
+static int receiveSocket(int fd, pid_t *pid)
+{
+	char control[CMSG_SPACE(sizeof(int))];
+	struct msghdr message;
+	struct iovec data;
+	struct cmsghdr *header;
+	int socket = -1;
+	
+	memset(&message, 0, sizeof(message));
+	
+	data.iov_base = pid;
+	data.iov_len  = sizeof(*pid);
+	message.msg_iov        = &data;
+	message.msg_iovlen     = 1;
+	message.msg_control    = control;
+	message.msg_controllen = sizeof(control);
+	
+	if (recvmsg(fd, &message, MSG_CMSG_CLOEXEC) != sizeof(*pid))
+	{
+		*pid = -1;
+		return -1;
+	}
+	
+	header = CMSG_FIRSTHDR(&message);
+	
+	if ((header != NULL) && (header->cmsg_level == SOL_SOCKET) && (header->cmsg_type == SCM_RIGHTS))
+	{
+		memcpy(&socket, CMSG_DATA(header), sizeof(int));
+	}
+	
+	return socket;
+}
+
+// the child only keeps its own connection, and a reload is none of its business
+static void forkedWorker(WorkerPool *pool, int fd)
+{
+	closeInheritedFiles(fd);
+	signal(SIGHUP, SIG_IGN);
+	signal(SIGCHLD, SIG_DFL);
+	
+	workerProcess(pool, fd);
+}
+
+static int forkWorker(WorkerPool *pool, RecognizerWorker *worker)
+{
+	int fds[2];
+	
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+	{
+		logError("socketpair error for recognizer worker %d: %s.\n", worker->workerId, strerror(errno));
+		return 0;
+	}
+	
+	// do not let the child print our pending output again
+	fflush(stdout);
+	
+	worker->pid = fork();
+	
+	if (worker->pid == 0)
+	{
+		forkedWorker(pool, fds[1]);
+	}
+	
+	close(fds[1]);
+	
+	if (worker->pid < 0)
+	{
+		logError("fork error for recognizer worker %d: %s.\n", worker->workerId, strerror(errno));
+		close(fds[0]);
+		return 0;
+	}
+	
+	worker->socket = fds[0];
+	
+	return 1;
+}
+
+static int spawnWorker(WorkerPool *pool, RecognizerWorker *worker)
+{
+	char request = 1;
+	
+	if ((write(pool->spawner, &request, 1) != 1) ||
+		((worker->socket = receiveSocket(pool->spawner, &worker->pid)) < 0))
+	{
+		logError("Spawner of %s could not fork recognizer worker %d!\n", pool->configPath, worker->workerId);
+		return 0;
+	}
+	
+	return 1;
+}
+
+///////////////////////////////////////////////
+//
+// the spawner forks the workers of reloads: by then this process runs the
+// server's I/O, decode and logger threads, and a child forked from here would
+// inherit whatever locks they hold at that moment (malloc, stdio, logger) with
+// nobody to release them; the spawner is forked along with the first workers,
+// before the caller starts any threads, and stays single-threaded
+//
+// it ends when this process closes its connection (or dies), its workers are
+// reaped by the kernel, this process notices them ending by their connection
+//
+//////////////////////////////////////////////
+static void spawnerProcess(WorkerPool *pool, int fd)
+{
+	char request;
+	
+	signal(SIGCHLD, SIG_IGN);
+	
+	while (read(fd, &request, 1) == 1)
+	{
+		int fds[2];
+		pid_t pid = -1;
+		
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		{
+			sendSocket(fd, -1, pid);
+			continue;
+		}
+		
+		pid = fork();
+		
+		if (pid == 0)
+		{
+			forkedWorker(pool, fds[1]);
+		}
+		
+		close(fds[1]);
+		sendSocket(fd, (pid > 0) ? fds[0] : -1, pid);
+		close(fds[0]);
+	}
+	
+	_exit(EXIT_SUCCESS);
+}
+
+static void startSpawner(WorkerPool *pool)
+{
+	int fds[2];
+	
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0)
+	{
+		logError("socketpair error for the spawner of %s: %s, no reloads!\n", pool->configPath, strerror(errno));
+		return;
+	}
+	
+	fflush(stdout);
+	
+	pool->spawnerPid = fork();
+	
+	if (pool->spawnerPid == 0)
+	{
+		closeInheritedFiles(fds[1]);
+		signal(SIGHUP, SIG_IGN);
+		
+		spawnerProcess(pool, fds[1]);
+	}
+	
+	close(fds[1]);
+	
+	if (pool->spawnerPid < 0)
+	{
+		logError("fork error for the spawner of %s: %s, no reloads!\n", pool->configPath, strerror(errno));
+		close(fds[0]);
+		return;
+	}
+	
+	pool->spawner = fds[0];
+}
+
+static void stopSpawner(WorkerPool *pool)
+{
+	if (pool->spawner >= 0)
+	{
+		close(pool->spawner);
+		pool->spawner = -1;
+		waitpid(pool->spawnerPid, NULL, 0);
+	}
+}
+
+///////////////////////////////////////////////
+//
+// set up the worker pool, forking the worker processes if configured
+//
+// the first time before the server starts any threads, reloads through the spawner
+//
+//////////////////////////////////////////////
+static int workerSlots(void)
+{
+	return (workerCount > 0) ? workerCount : 1;
+}
+
+static RecognizerWorker *forkWorkers(WorkerPool *pool)
+{
+	RecognizerWorker *workers = (RecognizerWorker*) calloc(pool->count, sizeof(RecognizerWorker));
+	int i;
+	
+	for (i = 0; i < pool->count; i++)
+	{
+		workers[i].workerId  = newWorkerId(workers, i);
+		workers[i].inProcess = (workerCount == 0);
+		workers[i].socket    = -1;
+		pthread_mutex_init(&workers[i].mutex, NULL);
+	}
+	
+	for (i = 0; i < pool->count; i++)
+	{
+		RecognizerWorker *worker = &workers[i];
+		int started;
+		
+		if (worker->inProcess != 0)
+		{
+			continue;
+		}
+		
+		started = (pool->started != 0) ? spawnWorker(pool, worker) : forkWorker(pool, worker);
+		
+		if (started != 0)
+		{
+			logInfo("Started recognizer worker %d for %s, pid %d.\n", worker->workerId, pool->configPath, (int) worker->pid);
+		}
+	}
+	
+	return workers;
+}
+
+static void startWorkers(WorkerPool *pool)
+{
+	pool->count   = workerSlots();
+	pool->workers = forkWorkers(pool);
+	
+	if (workerCount > 0)
+	{
+		startSpawner(pool);
+	}
+	
+	pool->started = 1;
+}
+
+// ends the process of a worker, with worker->mutex held
+static void endWorker(RecognizerWorker *worker)
+{
+	// closing the connection ends the worker process
+	if (worker->socket >= 0)
+	{
+		close(worker->socket);
+		worker->socket = -1;
+		
+		// nothing to wait for if the spawner forked it, it is not our child
+		waitpid(worker->pid, NULL, 0);
+	}
+	
+	metricsSetBacklog(worker->workerId, 0);
+	
+	free(worker->text);
+	worker->text = NULL;
+	worker->textSize = 0;
+}
+
+static void freeWorkers(RecognizerWorker *workers, int count)
+{
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		endWorker(&workers[i]);
+		pthread_mutex_destroy(&workers[i].mutex);
+	}
+	
+	free(workers);
+}
+
+static void stopWorkers(WorkerPool *pool)
+{
+	int i;
+	
+	stopSpawner(pool);
+	freeWorkers(pool->workers, pool->count);
+	
+	for (i = 0; i < pool->retiredCount; i++)
+	{
+		freeWorkers(pool->retired[i], pool->count);
+	}
+	
+	free(pool->retired);
+	pool->retired      = NULL;
+	pool->retiredCount = 0;
+	pool->workers      = NULL;
+	pool->count        = 0;
+	pool->started      = 0;
+}
+
+///////////////////////////////////////////////
+//
+// warm-up of a set of workers in two steps, so that any number of worker
+// processes warm up in parallel: all requests first, then all replies
+//
+// the worker mutexes are held from the first to the second step
+//
+//////////////////////////////////////////////
+static void warmUpSend(RecognizerWorker *workers, int count, const WorkerWarmUp *request)
+{
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		RecognizerWorker *worker = &workers[i];
+		
+		pthread_mutex_lock(&worker->mutex);
+		
+		if ((worker->inProcess == 0) && (worker->socket >= 0) &&
+			(sendMessage(worker->socket, WORKER_WARMUP, 0, request, sizeof(WorkerWarmUp)) == 0))
+		{
+			workerLost(worker);
+		}
+	}
+}
+
+// returns the number of workers ready
+static int warmUpReceive(RecognizerWorker *workers, int count, const WorkerWarmUp *request)
+{
+	WorkerMessage reply;
+	int ready = 0;
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		RecognizerWorker *worker = &workers[i];
+		
+		if (worker->inProcess != 0)
+		{
+			ready += localWarmUp(request->warmUpMs, request->timeoutMs);
+		}
+		else if (worker->socket >= 0)
+		{
+			if (receiveMessage(worker->socket, &reply, &worker->text, &worker->textSize) == 0)
+			{
+				workerLost(worker);
+			}
+			else if (reply.status == 0)
+			{
+				logError("Recognizer worker %d did not come online!\n", worker->workerId);
+			}
+			else
+			{
+				ready++;
+			}
+		}
+		
+		pthread_mutex_unlock(&worker->mutex);
+	}
+	
+	return ready;
+}
+
+// set by vosk_dlabpro_warm_up()
+static int recognizersReady = 0;
+
+int vosk_dlabpro_warm_up(int warmup_ms, int timeout_ms)
+{
+	WorkerWarmUp request;
+	WorkerPool *pool;
+	int ready = 1;
+	
+	logInfo("vosk_dlabpro_warm_up, warmup_ms=%d, timeout_ms=%d.\n", warmup_ms, timeout_ms);
+	
+	request.warmUpMs  = warmup_ms;
+	request.timeoutMs = timeout_ms;
+	
+	for (pool = workerPools; pool != NULL; pool = pool->next)
+	{
+		warmUpSend(pool->workers, pool->count, &request);
+	}
+	
+	for (pool = workerPools; pool != NULL; pool = pool->next)
+	{
+		// sessions of the pool would have no recognizer at all
+		if (warmUpReceive(pool->workers, pool->count, &request) == 0)
+		{
+			logError("No recognizer online for %s!\n", pool->configPath);
+			ready = 0;
+		}
+	}
+	
+	__atomic_store_n(&recognizersReady, ready, __ATOMIC_RELEASE);
+	
+	return ready;
+}
+
+int vosk_dlabpro_ready(void)
+{
+	WorkerPool *pool;
+	int ready = 1;
+	int i;
+	
+	if (__atomic_load_n(&recognizersReady, __ATOMIC_ACQUIRE) == 0)
+	{
+		return 0;
+	}
+	
+	// a pool whose workers all died cannot serve anybody (a reload may swap the workers meanwhile)
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	for (pool = workerPools; pool != NULL; pool = pool->next)
+	{
+		int alive = 0;
+		
+		for (i = 0; i < pool->count; i++)
+		{
+			alive |= workerAlive(&pool->workers[i]);
+		}
+		
+		ready &= (alive != 0);
+	}
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	return ready;
+}
+
+///////////////////////////////////////////////
+//
+// scheduling of the workers among the sessions
+//
+// a session keeps its worker while somebody talks, sessions without a worker
+// queue their audio meanwhile; a worker changes hands when it is free, when
+// its session received no audio for a while, or when its session is between
+// two utterances and others are waiting (the recognizer's state belongs to one
+// speaker, so it cannot switch within an utterance)
+//
+//////////////////////////////////////////////
+
+// a session that received no audio for this long loses its worker, and is passed over while waiting
+// (from the audio arriving, not from the calls, which may wait for a thread of the server)
+#define SCHEDULER_IDLE_SECONDS  2.0
+
+// queued audio this loud (RMS of a chunk) counts as speech for VOSK_DLABPRO_SCHEDULE_SPEECH
+#define SCHEDULER_SPEECH_RMS    0.01f
+
+// the final result of a session waits this long for a worker to decode its queue
+#define SCHEDULER_FINAL_WAIT_MS 10000
+
+// owners going idle are not signalled, a waiting final result checks for them this often
+#define SCHEDULER_IDLE_CHECK_MS 100
+
+// ends the utterance of an owner that stopped sending in the middle of it, before the worker changes hands
+#define SCHEDULER_FLUSH_SILENCE_MS 1000
+
+static int schedulerPolicy = VOSK_DLABPRO_SCHEDULE_FIFO;
+static int sessionQueueSamples = 10 * RECOGNIZER_SAMPLE_RATE;
+
+///////////////////////////////////////////////
+//
+// functions with "Locked" at the end must be called with workerPoolMutex held
+//
+//////////////////////////////////////////////
+static double receivedTime(VoskRecognizer *recognizer)
+{
+	double received;
+	
+	// written by vosk_dlabpro_audio_received() without the mutex
+	__atomic_load(&recognizer->receivedTime, &received, __ATOMIC_RELAXED);
+	
+	return received;
+}
+
+// the owner of the worker received no audio for a while (or it was just assigned)
+static int ownerIdleLocked(RecognizerWorker *worker, double now)
+{
+	if (worker->owner == NULL)
+	{
+		return 1;
+	}
+	
+	return (now - worker->assignedTime > SCHEDULER_IDLE_SECONDS) && (now - receivedTime(worker->owner) > SCHEDULER_IDLE_SECONDS);
+}
+
+static RecognizerWorker *ownedWorkerLocked(VoskRecognizer *recognizer)
+{
+	RecognizerWorker *worker = recognizer->worker;
+	
+	if ((worker != NULL) && (worker->owner == recognizer) && (workerAlive(worker) != 0))
+	{
+		return worker;
+	}
+	
+	return NULL;
+}
+
+static void startWaitingLocked(VoskRecognizer *recognizer, double now)
+{
+	if (recognizer->waiting == 0)
+	{
+		recognizer->waiting      = 1;
+		recognizer->waitingSince = now;
+		recognizer->nextWaiting  = recognizer->pool->waitingSessions;
+		recognizer->pool->waitingSessions = recognizer;
+		metricsGaugeAdd(METRIC_SESSIONS_WAITING, 1);
+	}
+}
+
+static void stopWaitingLocked(VoskRecognizer *recognizer)
+{
+	VoskRecognizer **link = &recognizer->pool->waitingSessions;
+	
+	if (recognizer->waiting == 0)
+	{
+		return;
+	}
+	
+	metricsGaugeAdd(METRIC_SESSIONS_WAITING, -1);
+	
+	while (*link != NULL)
+	{
+		if (*link == recognizer)
+		{
+			*link = recognizer->nextWaiting;
+			break;
+		}
+		
+		link = &(*link)->nextWaiting;
+	}
+	
+	recognizer->waiting     = 0;
+	recognizer->nextWaiting = NULL;
+}
+
+///////////////////////////////////////////////
+//
+// the waiting session of the pool to be served next according to the policy
+//
+//////////////////////////////////////////////
+static VoskRecognizer *nextWaiterLocked(WorkerPool *pool, double now)
+{
+	VoskRecognizer *session;
+	VoskRecognizer *chosen = NULL;
+	
+	for (session = pool->waitingSessions; session != NULL; session = session->nextWaiting)
+	{
+		// it would hold up the others until its audio continues
+		if ((session->finalWaiting == 0) && (now - receivedTime(session) > SCHEDULER_IDLE_SECONDS))
+		{
+			continue;
+		}
+		
+		if (chosen == NULL)
+		{
+			chosen = session;
+			continue;
+		}
+		
+		if (schedulerPolicy == VOSK_DLABPRO_SCHEDULE_SPEECH)
+		{
+			int speech       = (session->queuedPeak >= SCHEDULER_SPEECH_RMS);
+			int chosenSpeech = (chosen->queuedPeak >= SCHEDULER_SPEECH_RMS);
+			
+			if (speech != chosenSpeech)
+			{
+				if (speech != 0)
+				{
+					chosen = session;
+				}
+				
+				continue;
+			}
+		}
+		
+		if (session->waitingSince < chosen->waitingSince)
+		{
+			chosen = session;
+		}
+	}
+	
+	return chosen;
+}
+
+static void assignWorkerLocked(RecognizerWorker *worker, VoskRecognizer *recognizer, double now)
+{
+	double waited = now - recognizer->waitingSince;
+	
+	logInfo("Changing active instance of worker %d from %d:%d to %d:%d after %d ms waiting.\n", worker->workerId,
+		(worker->owner != NULL) ? worker->owner->instanceId : -1, (worker->owner != NULL) ? worker->owner->modelInstanceId : -1,
+		recognizer->instanceId, recognizer->modelInstanceId, (int) (waited * 1000));
+	
+	// the previous owner notices on its next call and queues from then on
+	worker->owner        = recognizer;
+	worker->assignedTime = now;
+	recognizer->worker   = worker;
+	
+	stopWaitingLocked(recognizer);
+	
+	metricsObserve(METRIC_QUEUE_WAIT_SECONDS, waited);
+	recognizer->waitSeconds += waited;
+	recognizer->waitTurns++;
+}
+
+// the owner's last feed left the recognizer possibly between two utterances
+static int boundaryPossible(RecognizerWorker *worker)
+{
+	return (__atomic_load_n(&worker->speaking, __ATOMIC_RELAXED) == 0) &&
+		(__atomic_load_n(&worker->resultsPending, __ATOMIC_RELAXED) == 0) &&
+		(__atomic_load_n(&worker->boundaryChecked, __ATOMIC_RELAXED) == 0);
+}
+
+// the instance still owns the worker, to be checked with worker->mutex held before using it
+static int workerOwnedBy(RecognizerWorker *worker, VoskRecognizer *recognizer)
+{
+	int owned;
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	owned = (ownedWorkerLocked(recognizer) == worker);
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	return owned;
+}
+
+///////////////////////////////////////////////
+//
+// nothing of the owner may reach the next session of a worker: the backlog is
+// decoded, an utterance still going on is ended with silence, and its texts
+// are kept for the owner, which gets them with its next result
+//
+// returns 1 if the recognizer is between two utterances with no text pending then,
+// with worker->mutex held
+//
+//////////////////////////////////////////////
+static int flushOwner(RecognizerWorker *worker, VoskRecognizer *owner)
+{
+	static const float silence[SCHEDULER_FLUSH_SILENCE_MS * (RECOGNIZER_SAMPLE_RATE / 1000)] = { 0.0f };
+	const char *text;
+	
+	if (workerDrain(worker) != 0)
+	{
+		return 1;
+	}
+	
+	if (workerAlive(worker) == 0)
+	{
+		return 0;
+	}
+	
+	logInfo("Ending the utterance of instance %d on worker %d before handing it over.\n", owner->instanceId, worker->workerId);
+	
+	workerFeed(worker, silence, sizeof(silence) / sizeof(float));
+	text = workerText(worker, WORKER_FINAL);
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	// unless the owner is gone meanwhile
+	if ((text != NULL) && (text[0] != 0) && (worker->owner == owner))
+	{
+		storeText(&owner->heldText, &owner->heldTextSize, text, 1);
+	}
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	return workerDrain(worker);
+}
+
+// the texts flushOwner() kept for the instance, NULL if none, to be freed by the caller
+static char *takeHeldText(VoskRecognizer *recognizer)
+{
+	char *text;
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	text = recognizer->heldText;
+	recognizer->heldText     = NULL;
+	recognizer->heldTextSize = 0;
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	return text;
+}
+
+static int heldTextPending(VoskRecognizer *recognizer)
+{
+	int pending;
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	pending = (recognizer->heldText != NULL);
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	return pending;
+}
+
+///////////////////////////////////////////////
+//
+// take a worker over from its owner, if the owner received no audio for a while
+// or the worker turns out to be between two utterances
+//
+// holding worker->mutex keeps the owner from feeding meanwhile
+//
+//////////////////////////////////////////////
+static RecognizerWorker *takeOverWorker(VoskRecognizer *recognizer, RecognizerWorker *worker, VoskRecognizer *owner)
+{
+	RecognizerWorker *taken = NULL;
+	int idle, boundary;
+	
+	pthread_mutex_lock(&worker->mutex);
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	idle = ownerIdleLocked(worker, metricsTime()) && (worker->owner == owner) && (owner != NULL);
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	// decodes what the owner fed last, so this waits for its backlog; an idle
+	// owner's utterance ends here, a busy owner keeps the worker until it ends
+	boundary = (idle != 0) ? flushOwner(worker, owner) : workerDrain(worker);
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	if ((worker->owner == owner) && (recognizer->waiting != 0) && (boundary != 0))
+	{
+		assignWorkerLocked(worker, recognizer, metricsTime());
+		taken = worker;
+	}
+	else
+	{
+		__atomic_store_n(&worker->boundaryChecked, 1, __ATOMIC_RELAXED);
+	}
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+	pthread_mutex_unlock(&worker->mutex);
+	
+	return taken;
+}
+
+///////////////////////////////////////////////
+//
+// give up a worker retired by a reload if it is between two utterances,
+// the instance gets one of the new workers then
+//
+//////////////////////////////////////////////
+static int leaveRetiredWorker(VoskRecognizer *recognizer, RecognizerWorker *worker)
+{
+	int boundary;
+	
+	pthread_mutex_lock(&worker->mutex);
+	
+	boundary = workerDrain(worker);
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	if ((boundary != 0) && (worker->owner == recognizer))
+	{
+		logInfo("Instance %d leaves retired worker %d.\n", recognizer->instanceId, worker->workerId);
+		worker->owner      = NULL;
+		recognizer->worker = NULL;
+		pthread_cond_broadcast(&workerFreeCond);
+	}
+	else
+	{
+		__atomic_store_n(&worker->boundaryChecked, 1, __ATOMIC_RELAXED);
+		boundary = 0;
+	}
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+	pthread_mutex_unlock(&worker->mutex);
+	
+	return boundary;
+}
+
+///////////////////////////////////////////////
+//
+// the worker serving this instance; if it has none, queue it and
+// assign a worker if it is its turn and one can be had
+//
+// returns NULL if the instance has to wait
+//
+//////////////////////////////////////////////
+static RecognizerWorker *scheduleWorker(VoskRecognizer *recognizer)
+{
+	RecognizerWorker *worker;
+	RecognizerWorker *candidate = NULL;
+	VoskRecognizer *candidateOwner = NULL;
+	int retired = 0;
+	double now = metricsTime();
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	worker = ownedWorkerLocked(recognizer);
+	
+	if (worker != NULL)
+	{
+		retired = (worker->retired != 0) && (boundaryPossible(worker) != 0);
+	}
+	else if (recognizer->pool->started != 0)
+	{
+		startWaitingLocked(recognizer, now);
+		
+		if (nextWaiterLocked(recognizer->pool, now) == recognizer)
+		{
+			int i;
+			
+			for (i = 0; i < recognizer->pool->count; i++)
+			{
+				RecognizerWorker *slot = &recognizer->pool->workers[i];
+				
+				if (workerAlive(slot) == 0)
+				{
+					continue;
+				}
+				
+				// prefer a worker nobody uses
+				if (slot->owner == NULL)
+				{
+					worker = slot;
+					break;
+				}
+				
+				// otherwise one whose owner went quiet
+				if ((candidate == NULL) && ((ownerIdleLocked(slot, now) != 0) || (boundaryPossible(slot) != 0)))
+				{
+					candidate      = slot;
+					candidateOwner = slot->owner;
+				}
+			}
+			
+			if (worker != NULL)
+			{
+				assignWorkerLocked(worker, recognizer, now);
+			}
+		}
+	}
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	if ((worker == NULL) && (candidate != NULL))
+	{
+		worker = takeOverWorker(recognizer, candidate, candidateOwner);
+	}
+	
+	// once more, without a worker now
+	if ((retired != 0) && (leaveRetiredWorker(recognizer, worker) != 0))
+	{
+		worker = scheduleWorker(recognizer);
+	}
+	
+	return worker;
+}
+
+// the worker serving this instance, NULL if it has none (no scheduling)
+static RecognizerWorker *activeWorker(VoskRecognizer *recognizer)
+{
+	RecognizerWorker *worker;
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	worker = ownedWorkerLocked(recognizer);
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	return worker;
+}
+
+static void releaseWorker(VoskRecognizer *recognizer)
+{
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	if ((recognizer->worker != NULL) && (recognizer->worker->owner == recognizer))
+	{
+		recognizer->worker->owner = NULL;
+		pthread_cond_broadcast(&workerFreeCond);
+	}
+	
+	recognizer->worker = NULL;
+	stopWaitingLocked(recognizer);
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+}
+
+///////////////////////////////////////////////
+//
+// the queue of an instance waiting for a worker, only used by the instance's own calls
+//
+//////////////////////////////////////////////
+static void queueSamples(VoskRecognizer *recognizer, const float *samples, int count)
+{
+	int dropped = recognizer->queuedCount + count - sessionQueueSamples;
+	float energy = 0.0f;
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		energy += samples[i] * samples[i];
+	}
+	
+	if ((count > 0) && (sqrtf(energy / count) > recognizer->queuedPeak))
+	{
+		recognizer->queuedPeak = sqrtf(energy / count);
+	}
+	
+	// the oldest audio goes first
+	if (dropped > 0)
+	{
+		if (dropped >= recognizer->queuedCount)
+		{
+			samples += dropped - recognizer->queuedCount;
+			count   -= dropped - recognizer->queuedCount;
+			recognizer->queuedCount = 0;
+		}
+		else
+		{
+			memmove(recognizer->queued, recognizer->queued + dropped, (recognizer->queuedCount - dropped) * sizeof(float));
+			recognizer->queuedCount -= dropped;
+		}
+		
+		metricsAdd(METRIC_QUEUE_DROPPED_SAMPLES, dropped);
+		logInfo("Queue of instance %d full, dropped %d ms.\n", recognizer->instanceId, dropped * 1000 / RECOGNIZER_SAMPLE_RATE);
+	}
+	
+	if (recognizer->queuedCount + count > recognizer->queuedSize)
+	{
+		recognizer->queuedSize = recognizer->queuedCount + count;
+		recognizer->queued = (float*) realloc(recognizer->queued, recognizer->queuedSize * sizeof(float));
+	}
+	
+	memcpy(recognizer->queued + recognizer->queuedCount, samples, count * sizeof(float));
+	recognizer->queuedCount += count;
+}
+
+///////////////////////////////////////////////
+//
+// feed the queue of the instance (if any) and then the samples,
+// with worker->mutex held and the worker owned by the instance
+//
+//////////////////////////////////////////////
+static int feedSession(VoskRecognizer *recognizer, RecognizerWorker *worker, const float *samples, int count)
+{
+	int retVal;
+	
+	if (recognizer->queuedCount == 0)
+	{
+		return workerFeed(worker, samples, count);
+	}
+	
+	queueSamples(recognizer, samples, count);
+	retVal = workerFeed(worker, recognizer->queued, recognizer->queuedCount);
+	
+	recognizer->queuedCount = 0;
+	recognizer->queuedPeak  = 0.0f;
+	
+	return retVal;
+}
+
+///////////////////////////////////////////////
+//
+// at the end of the stream, the queued audio is worth waiting for a worker
+//
+//////////////////////////////////////////////
+static void startFinalWait(VoskRecognizer *recognizer)
+{
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	if (recognizer->finalWaiting == 0)
+	{
+		recognizer->finalWaiting = 1;
+		recognizer->finalSince   = metricsTime();
+	}
+	
+	pthread_mutex_unlock(&workerPoolMutex);
+}
+
+static RecognizerWorker *finalWorker(VoskRecognizer *recognizer)
+{
+	RecognizerWorker *worker = scheduleWorker(recognizer);
+	double deadline;
+	
+	pthread_once(&recognizerStateOnce, initRecognizerState);
+	
+	// vosk_dlabpro_final_ready() may have started the wait
+	startFinalWait(recognizer);
+	deadline = recognizer->finalSince + SCHEDULER_FINAL_WAIT_MS / 1000.0;
+	
+	// woken when a worker is released or may be at an utterance boundary
+	while ((worker == NULL) && (recognizer->queuedCount > 0) && (metricsTime() < deadline))
+	{
+		struct timespec wakeup;
+		
+		clock_gettime(CLOCK_MONOTONIC, &wakeup);
+		addMilliseconds(&wakeup, SCHEDULER_IDLE_CHECK_MS);
+		
+		pthread_mutex_lock(&workerPoolMutex);
+		pthread_cond_timedwait(&workerFreeCond, &workerPoolMutex, &wakeup);
+		pthread_mutex_unlock(&workerPoolMutex);
+		
+		worker = scheduleWorker(recognizer);
+	}
+	
+	pthread_mutex_lock(&workerPoolMutex);
+	recognizer->finalWaiting = 0;
+	recognizer->finalSince   = 0.0;
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	if ((worker == NULL) && (recognizer->queuedCount > 0))
+	{
+		logError("No recognizer for instance %d within %d ms, dropping %d ms of audio!\n", recognizer->instanceId,
+			SCHEDULER_FINAL_WAIT_MS, recognizer->queuedCount * 1000 / RECOGNIZER_SAMPLE_RATE);
+		
+		metricsAdd(METRIC_QUEUE_DROPPED_SAMPLES, recognizer->queuedCount);
+		recognizer->queuedCount = 0;
+	}
+	
+	return worker;
+}
+
+///////////////////////////////////////////////
+//
+// for servers which must not block a thread on the final result: once this
+// returns 1, vosk_recognizer_final_result() does not wait for a worker
+//
+//////////////////////////////////////////////
+int vosk_dlabpro_final_ready(VoskRecognizer *recognizer)
+{
+	if (recognizer->queuedCount == 0)
+	{
+		return 1;
+	}
+	
+	startFinalWait(recognizer);
+	
+	// after the wait the queued audio is dropped
+	return (scheduleWorker(recognizer) != NULL) || (metricsTime() - recognizer->finalSince >= SCHEDULER_FINAL_WAIT_MS / 1000.0);
+}
+
+///////////////////////////////////////////////
+//
+// reload: new workers start with the configuration as it is now and warm up
+// while the old ones keep serving, then they take over; sessions move at their
+// next utterance boundary, and each old worker ends once its session moved on
+//
+//////////////////////////////////////////////
+
+// a session holding a retired worker is checked this often
+#define RELOAD_POLL_MS 100
+
+// ends the retired workers without an owner, or whose owner received no audio
+// or is between two utterances (e.g. silent), returns the number of those still in use
+static int endRetiredWorkers(RecognizerWorker *workers, int count)
+{
+	int inUse = 0;
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		RecognizerWorker *worker = &workers[i];
+		VoskRecognizer *owner;
+		int idle, boundary;
+		
+		pthread_mutex_lock(&worker->mutex);
+		pthread_mutex_lock(&workerPoolMutex);
+		
+		owner = worker->owner;
+		idle = ownerIdleLocked(worker, metricsTime());
+		boundary = (idle == 0) && (boundaryPossible(worker) != 0);
+		
+		pthread_mutex_unlock(&workerPoolMutex);
+		
+		// the owner's utterance ends with the worker, its text goes to the owner
+		if ((idle != 0) && (owner != NULL))
+		{
+			flushOwner(worker, owner);
+		}
+		
+		// holding worker->mutex keeps the owner from feeding meanwhile
+		if (boundary != 0)
+		{
+			boundary = workerDrain(worker);
+			
+			if (boundary == 0)
+			{
+				__atomic_store_n(&worker->boundaryChecked, 1, __ATOMIC_RELAXED);
+			}
+		}
+		
+		idle |= boundary;
+		
+		// the owner notices on its next call and gets a new worker
+		if (idle != 0)
+		{
+			pthread_mutex_lock(&workerPoolMutex);
+			worker->owner = NULL;
+			pthread_cond_broadcast(&workerFreeCond);
+			pthread_mutex_unlock(&workerPoolMutex);
+		}
+		
+		if ((idle != 0) && (worker->socket >= 0))
+		{
+			logInfo("Ending retired recognizer worker %d, pid %d.\n", worker->workerId, (int) worker->pid);
+			endWorker(worker);
+		}
+		
+		inUse += (idle == 0);
+		
+		pthread_mutex_unlock(&worker->mutex);
+	}
+	
+	return inUse;
+}
+
+int vosk_dlabpro_reload(int warmup_ms, int timeout_ms)
+{
+	WorkerWarmUp request;
+	WorkerPool *pool;
+	RecognizerWorker **fresh;
+	int pools = 0;
+	int ready = 1;
+	int inUse;
+	int i;
+	
+	logInfo("vosk_dlabpro_reload, warmup_ms=%d, timeout_ms=%d.\n", warmup_ms, timeout_ms);
+	
+	// the recognizer keeps its state in globals, there is no second one in this process
+	if ((workerCount == 0) || (workerPools == NULL))
+	{
+		logError("Error! Reloading needs recognizer workers, the recognizer runs in this process!\n");
+		return 0;
+	}
+	
+	if (__atomic_exchange_n(&reloadRunning, 1, __ATOMIC_ACQ_REL) != 0)
+	{
+		logError("Error! A reload is running already!\n");
+		return 0;
+	}
+	
+	request.warmUpMs  = warmup_ms;
+	request.timeoutMs = timeout_ms;
+	
+	for (pool = workerPools; pool != NULL; pool = pool->next)
+	{
+		pools++;
+	}
+	
+	fresh = (RecognizerWorker**) calloc(pools, sizeof(RecognizerWorker*));
+	
+	// start and warm up the new workers of all pools, the old ones keep serving meanwhile
+	for (pool = workerPools, i = 0; pool != NULL; pool = pool->next, i++)
+	{
+		fresh[i] = forkWorkers(pool);
+		warmUpSend(fresh[i], pool->count, &request);
+	}
+	
+	for (pool = workerPools, i = 0; pool != NULL; pool = pool->next, i++)
+	{
+		if (warmUpReceive(fresh[i], pool->count, &request) == 0)
+		{
+			logError("No new recognizer online for %s, keeping the old ones!\n", pool->configPath);
+			ready = 0;
+		}
+	}
+	
+	if (ready == 0)
+	{
+		for (pool = workerPools, i = 0; pool != NULL; pool = pool->next, i++)
+		{
+			freeWorkers(fresh[i], pool->count);
+		}
+		
+		free(fresh);
+		__atomic_store_n(&reloadRunning, 0, __ATOMIC_RELEASE);
+		
+		return 0;
+	}
+	
+	// the new workers take over, sessions owning an old one keep it until an utterance boundary
+	pthread_mutex_lock(&workerPoolMutex);
+	
+	for (pool = workerPools, i = 0; pool != NULL; pool = pool->next, i++)
+	{
+		int j;
+		
+		for (j = 0; j < pool->count; j++)
+		{
+			pool->workers[j].retired = 1;
+		}
+		
+		pool->retired = (RecognizerWorker**) realloc(pool->retired, (pool->retiredCount + 1) * sizeof(RecognizerWorker*));
+		pool->retired[pool->retiredCount++] = pool->workers;
+		pool->workers = fresh[i];
+		
+		// the old workers were retired with this very reload
+		fresh[i] = pool->retired[pool->retiredCount - 1];
+	}
+	
+	pthread_cond_broadcast(&workerFreeCond);
+	pthread_mutex_unlock(&workerPoolMutex);
+	
+	do
+	{
+		inUse = 0;
+		
+		for (pool = workerPools, i = 0; pool != NULL; pool = pool->next, i++)
+		{
+			inUse += endRetiredWorkers(fresh[i], pool->count);
+		}
+		
+		if (inUse > 0)
+		{
+			usleep(RELOAD_POLL_MS * 1000);
+		}
+	}
+	while (inUse > 0);
+	
+	free(fresh);
+	
+	metricsAdd(METRIC_RELOADS, 1);
+	logInfo("Reload done, all sessions moved to the new recognizers.\n");
+	
+	__atomic_store_n(&reloadRunning, 0, __ATOMIC_RELEASE);
+	
+	return 1;
+}
+
+///////////////////////////////////////////////
+void vosk_dlabpro_set_workers(int workers)
+{
+	logInfo("vosk_dlabpro_set_workers, workers=%d.\n", workers);
+	
+	workerCount = (workers > 0) ? workers : 0;
+}
+
+int vosk_dlabpro_get_parallel_recognizers(void)
+{
+	return workerSlots();
+}
+
+void vosk_dlabpro_set_voice_filter(int enabled, float threshold_db, int hangover_ms, int preroll_ms)
+{
+	logInfo("vosk_dlabpro_set_voice_filter, enabled=%d, threshold_db=%.1f, hangover_ms=%d, preroll_ms=%d.\n", enabled, threshold_db, hangover_ms, preroll_ms);
+	
+	voiceFilterEnabled     = enabled;
+	voiceFilterThresholdDb = threshold_db;
+	voiceFilterHangoverMs  = hangover_ms;
+	voiceFilterPrerollMs   = preroll_ms;
+}
+
+void vosk_dlabpro_set_partial_interval(int interval_ms)
+{
+	logInfo("vosk_dlabpro_set_partial_interval, interval_ms=%d.\n", interval_ms);
+	
+	partialInterval = (interval_ms > 0) ? interval_ms / 1000.0 : 0.0;
+}
+
+void vosk_dlabpro_set_scheduler(int policy, int queue_ms)
+{
+	logInfo("vosk_dlabpro_set_scheduler, policy=%d, queue_ms=%d.\n", policy, queue_ms);
+	
+	schedulerPolicy = policy;
+	sessionQueueSamples = (queue_ms > 0) ? queue_ms * (RECOGNIZER_SAMPLE_RATE / 1000) : 1;
+}
+
+///////////////////////////////////////////////
+//
+// there is no Kaldi here, the level applies to the messages of this wrapper
+// (per chunk messages are debug level, so the default level keeps them off)
+//
+//////////////////////////////////////////////
+void vosk_set_log_level(int log_level)
+{
+	logSetLevel(log_level);
+}
+
+///////////////////////////////////////////////
+//
+// the directory of a model holds recognizer.cfg, a file is taken as the configuration itself
+//
+//////////////////////////////////////////////
+static char *configPath(const char *modelPath)
+{
+	struct stat info;
+	char *path;
+	
+	if ((stat(modelPath, &info) == 0) && S_ISDIR(info.st_mode))
+	{
+		path = (char*) malloc(strlen(modelPath) + strlen("/recognizer.cfg") + 1);
+		sprintf(path, "%s/recognizer.cfg", modelPath);
+		return path;
+	}
+	
+	return strdup(modelPath);
+}
+
+static WorkerPool *findPool(const char *path)
+{
+	WorkerPool *pool;
+	
+	for (pool = workerPools; pool != NULL; pool = pool->next)
+	{
+		if (strcmp(pool->configPath, path) == 0)
+		{
+			return pool;
+		}
+	}
+	
+	return NULL;
+}
+
+///////////////////////////////////////////////
+//
+// start the recognizer(s) of a configuration, NULL if that is not possible
+//
+//////////////////////////////////////////////
+static WorkerPool *startPool(char *path)
+{
+	WorkerPool *pool;
+	
+	// the recognizer keeps its state in globals, only one of them fits into this process
+	if ((workerCount == 0) && (workerPools != NULL))
+	{
+		logError("Error! %s needs recognizer workers, %s runs in this process already!\n", path, workerPools->configPath);
+		return NULL;
+	}
+	
+	pool = (WorkerPool*) calloc(1, sizeof(WorkerPool));
+	pool->configPath = path;
+	pool->spawner    = -1;
+	pool->argv[0] = "";
+	pool->argv[1] = "-cfg";
+	pool->argv[2] = path;
+	pool->argv[3] = "-out";
+	pool->argv[4] = "vad";
+	
+	// the workers count into the same metrics
+	if (workerPools == NULL)
+	{
+		metricsInit();
+	}
+	
+	pool->next  = workerPools;
+	workerPools = pool;
+	
+	startWorkers(pool);
+	
+	if (workerCount == 0)
+	{
+		int retVal = pthread_create(&pool->recognizerThreadId,
+			NULL,
+			recognizerThread,
+			pool);
+		
+		if (retVal != 0)
+		{
+			logError("recognizer thread start error: %d.\n", retVal);
+		}
+		
+		startFeeder();
+	}
+	
+	return pool;
+}
+
+static void stopPool(WorkerPool *pool)
+{
+	WorkerPool **link = &workerPools;
+	
+	if (workerCount == 0)
+	{
+		stopFeeder();
+		recognizer_exit();
+		
+		int retVal = pthread_join(pool->recognizerThreadId, NULL);
+		
+		if (retVal != 0)
+		{
+			logError("recognizer thread join error: %d.\n", retVal);
+		}
+	}
+	
+	stopWorkers(pool);
+	
+	while (*link != pool)
+	{
+		link = &(*link)->next;
+	}
+	
+	*link = pool->next;
+	
+	free(pool->configPath);
+	free(pool);
+}
+
+///////////////////////////////////////////////
+//
+// re-use the model API for spawning the recognizer
+//
+// the model path is a directory with recognizer.cfg or the configuration file,
+// models of the same configuration share the recognizer(s), every other
+// configuration gets its own (which needs worker processes)
+//
+// must be called before the server starts any threads
+//
+//////////////////////////////////////////////
+VoskModel *vosk_model_new(const char *model_path)
+{
+	VoskModel* instance;
+	WorkerPool *pool;
+	char *path;
+	
+	logInfo("vosk_model_new, path=%s, instance=%d.\n", model_path, voskModelInstanceId);
+	
+	path = configPath(model_path);
+	pool = findPool(path);
+	
+	if (pool != NULL)
+	{
+		free(path);
+	}
+	else
+	{
+		if (access(path, R_OK) != 0)
+		{
+			logError("Error! Cannot read recognizer configuration %s: %s!\n", path, strerror(errno));
+			free(path);
+			return NULL;
+		}
+		
+		pool = startPool(path);
+		
+		if (pool == NULL)
+		{
+			free(path);
+			return NULL;
+		}
+	}
+	
+	instance = (VoskModel*) malloc(sizeof(VoskModel));
+	instance->instanceId = voskModelInstanceId;
+	instance->pool = pool;
+	pool->models++;
+	
+	voskModelInstanceId++;
+	return instance;
+}
+
+///////////////////////////////////////////////
+//
+// likely to be never called by the server
+//
+//////////////////////////////////////////////
+void vosk_model_free(VoskModel *model)
+{
+	logInfo("vosk_model_free, instance=%d\n", model->instanceId);
+	
+	// destroying the last model of a configuration also ends its recognizer thread (or processes)
+	if (--model->pool->models == 0)
+	{
+		stopPool(model->pool);
+	}
+	
+	free(model);
+	
+	voskModelInstanceId--;
+}
+
+///////////////////////////////////////////////
+//
+// partial results are handed out as a JSON string, which is only built
+// again when the text changed
+//
+//////////////////////////////////////////////
+static void setPartial(VoskRecognizer *recognizer, const char *text)
+{
+	storeText(&recognizer->partialText, &recognizer->partialTextSize, text, 0);
+	
+	jsonBufferClear(&recognizer->partial);
+	jsonBufferAppend(&recognizer->partial, "{ \"partial\" : \"");
+	jsonBufferAppendEscaped(&recognizer->partial, text);
+	jsonBufferAppend(&recognizer->partial, "\" }");
+}
+
+// a JSON string which ran out of memory is incomplete, the text is lost then (and logged)
+static const char *jsonResult(const JsonBuffer *buffer, const char *empty)
+{
+	return (jsonBufferFailed(buffer) != 0) ? empty : jsonBufferText(buffer);
+}
+
+///////////////////////////////////////////////
+//
+// every server session creates one recognizer instance
+//
+// e.g. one conference member == one session == one instance
+//
+// sample rate is set by the server (and defined as environment on the command line),
+// a client may change it with vosk_dlabpro_set_sample_rate()
+//
+//////////////////////////////////////////////
+VoskRecognizer *vosk_recognizer_new(VoskModel *model, float sample_rate)
+{
+	VoskRecognizer* instance;
+	logInfo("vosk_recognizer_new, sample_rate=%.2f, instance=%d, modelInstaceId=%d.\n", sample_rate, voskRecognizerInstanceId, model->instanceId);
+	
+	instance = (VoskRecognizer*) malloc(sizeof(VoskRecognizer));
+	
+	// filter tables are shared, only the filter state belongs to this instance
+	// (only whole rates can be resampled, checking it once here saves the per sample checks)
+	if ((sample_rate != (float) (int) sample_rate) || (resamplerInit(&instance->resampler, (int) sample_rate, RECOGNIZER_SAMPLE_RATE) == 0))
+	{
+		logError("Error! Unsupported sample rate=%.2f!\n", sample_rate);
+		free(instance);
+		return NULL;
+	}
+	
+	instance->instanceId = voskRecognizerInstanceId;
+	instance->modelInstanceId = model->instanceId;
+	instance->inputSampleRate = sample_rate;
+	instance->pool = model->pool;
+	instance->worker = NULL;
+	instance->input = NULL;
+	instance->inputSize = 0;
+	instance->hasPendingByte = 0;
+	instance->samples = NULL;
+	instance->samplesSize = 0;
+	instance->voiced = NULL;
+	instance->voicedSize = 0;
+	instance->queued = NULL;
+	instance->queuedCount = 0;
+	instance->queuedSize = 0;
+	instance->queuedPeak = 0.0f;
+	instance->waiting = 0;
+	instance->waitingSince = 0.0;
+	instance->receivedTime = metricsTime();
+	instance->finalWaiting = 0;
+	instance->finalSince = 0.0;
+	instance->waitSeconds = 0.0;
+	instance->waitTurns = 0;
+	instance->nextWaiting = NULL;
+	jsonBufferInit(&instance->result);
+	jsonBufferInit(&instance->partial);
+	instance->partialText = NULL;
+	instance->partialTextSize = 0;
+	instance->partialTime = 0.0;
+	instance->heldText = NULL;
+	instance->heldTextSize = 0;
+	setPartial(instance, "");
+	voiceFilterInit(&instance->voiceFilter, voiceFilterThresholdDb, voiceFilterHangoverMs, voiceFilterPrerollMs);
+	
+	metricsGaugeAdd(METRIC_RECOGNIZERS_ACTIVE, 1);
+	voskRecognizerInstanceId++;
+	
+	return instance;
+}
+
+///////////////////////////////////////////////
+//
+// the client told its rate, the conversion for it is picked here once
+// (the filter tables of a rate are shared by all instances using it)
+//
+//////////////////////////////////////////////
+int vosk_dlabpro_set_sample_rate(VoskRecognizer *recognizer, float sample_rate)
+{
+	Resampler resampler;
+	
+	if (sample_rate == recognizer->inputSampleRate)
+	{
+		return 1;
+	}
+	
+	if ((sample_rate != (float) (int) sample_rate) || (resamplerInit(&resampler, (int) sample_rate, RECOGNIZER_SAMPLE_RATE) == 0))
+	{
+		logError("Error! Unsupported sample rate=%.2f, instance=%d!\n", sample_rate, recognizer->instanceId);
+		return 0;
+	}
+	
+	logInfo("vosk_dlabpro_set_sample_rate, sample_rate=%.2f, instance=%d.\n", sample_rate, recognizer->instanceId);
+	
+	// input at the old rate which is still carried is dropped
+	resamplerFree(&recognizer->resampler);
+	recognizer->resampler       = resampler;
+	recognizer->inputSampleRate = sample_rate;
+	recognizer->hasPendingByte  = 0;
+	
+	return 1;
+}
+
+///////////////////////////////////////////////
+void vosk_dlabpro_audio_received(VoskRecognizer *recognizer)
+{
+	double now = metricsTime();
+	
+	__atomic_store(&recognizer->receivedTime, &now, __ATOMIC_RELAXED);
+}
+
+///////////////////////////////////////////////
+void vosk_recognizer_free(VoskRecognizer *recognizer)
+{
+	RecognizerWorker *worker = activeWorker(recognizer);
+	
+	logInfo("vosk_recognizer_free, instance=%d, waited %d ms for a recognizer in %d turns\n", recognizer->instanceId,
+		(int) (recognizer->waitSeconds * 1000), recognizer->waitTurns);
+	
+	// what is left of its audio and texts must not reach the next session
+	if (worker != NULL)
+	{
+		pthread_mutex_lock(&worker->mutex);
+		
+		if (workerOwnedBy(worker, recognizer) != 0)
+		{
+			flushOwner(worker, recognizer);
+			
+			// released below, nothing of this session is queued on it any more
+			workerSetBacklog(worker, 0);
+		}
+		
+		pthread_mutex_unlock(&worker->mutex);
+	}
+	
+	// the worker is free for other instances right away
+	releaseWorker(recognizer);
+	
+	metricsAdd(METRIC_QUEUE_DROPPED_SAMPLES, recognizer->queuedCount);
+	free(recognizer->heldText);
+	
+	jsonBufferFree(&recognizer->result);
+	jsonBufferFree(&recognizer->partial);
+	free(recognizer->partialText);
+	resamplerFree(&recognizer->resampler);
+	voiceFilterFree(&recognizer->voiceFilter);
+	free(recognizer->input);
+	free(recognizer->samples);
+	free(recognizer->voiced);
+	free(recognizer->queued);
+	free(recognizer);
+	
+	metricsGaugeAdd(METRIC_RECOGNIZERS_ACTIVE, -1);
+	voskRecognizerInstanceId--;
+}
 
 ///////////////////////////////////////////////
-//
-// tracking of the last active instance, because recognizer is
-// not (yet) capable of multiple instances
-//
-//////////////////////////////////////////////
-struct InstanceActivity
+void vosk_recognizer_set_max_alternatives(VoskRecognizer *recognizer, int max_alternatives)
 {
-	int instanceId;
-	int modelInstanceId;
-	struct timeval activeTime;
-};
+	// stub
+	logInfo("vosk_recognizer_set_max_alternatives, instance=%d, max_alternatives=%d.\n", recognizer->instanceId, max_alternatives);
+}
 
-static struct InstanceActivity activeInstance
+///////////////////////////////////////////////
+void vosk_recognizer_set_words(VoskRecognizer *recognizer, int words)
 {
-	.instanceId         = -1,
-	.modelInstanceId    = -1,
-	.activeTime         = { .tv_sec  = 0, .tv_usec = 0 }
-};
+	// stub
+	logInfo("vosk_recognizer_set_words, instance=%d, words=%d.\n", recognizer->instanceId, words);
+}
 
 ///////////////////////////////////////////////
 //
-// check whether this instance is still active,
-// or whether we can "steal" the recognizer from an inactive instance
+// common part of all accept_waveform variants, input holds
+// inputCount float samples at the input rate of this instance
+//
+// instances without a worker queue the audio until they get one
 //
 //////////////////////////////////////////////
-static int checkActiveInstance(VoskRecognizer *recognizer)
+static int acceptSamples(VoskRecognizer *recognizer, const float *input, int inputCount)
 {
-	struct timeval currTime;
-	int acceptInstance = 0;
-
-	if (gettimeofday(&currTime, NULL) != 0)
+	RecognizerWorker *worker;
+	const float *samples = input;
+	int sampleCount = inputCount;
+	double start = metricsTime();
+	int retVal = 0;
+	int fed = 0;
+	
+	// for callers which do not tell when the audio arrived
+	if (start > receivedTime(recognizer))
+	{
+		__atomic_store(&recognizer->receivedTime, &start, __ATOMIC_RELAXED);
+	}
+	
+	// 8kHz and 48kHz (or whatever the client sends) become 16kHz here, the
+	// filter state carries over to the next chunk of this instance
+	// (16kHz input is used as it is)
+	if (recognizer->resampler.filter != NULL)
 	{
-		printf("Error in gettimeofday()!\n");	
+		if (resamplerMaxOutput(&recognizer->resampler, inputCount) > recognizer->samplesSize)
+		{
+			recognizer->samplesSize = resamplerMaxOutput(&recognizer->resampler, inputCount);
+			recognizer->samples = (float*) realloc(recognizer->samples, recognizer->samplesSize * sizeof(float));
+		}
+		
+		sampleCount = resamplerProcess(&recognizer->resampler, input, inputCount, recognizer->samples);
+		samples = recognizer->samples;
+	}
+	
+	// long silence does not need to be decoded (a bit of it before and after voice does)
+	if (voiceFilterEnabled != 0)
+	{
+		if (voiceFilterMaxOutput(&recognizer->voiceFilter, sampleCount) > recognizer->voicedSize)
+		{
+			recognizer->voicedSize = voiceFilterMaxOutput(&recognizer->voiceFilter, sampleCount);
+			recognizer->voiced = (float*) realloc(recognizer->voiced, recognizer->voicedSize * sizeof(float));
+		}
+		
+		// voiced audio stays where it is, only gaps make a copy
+		samples = voiceFilterPass(&recognizer->voiceFilter, samples, sampleCount, recognizer->voiced, &sampleCount);
+		
+		metricsAdd(METRIC_SILENCE_SAMPLES, voiceFilterTakeDropped(&recognizer->voiceFilter));
 	}
 	
-	// same instance --> just refresh times
-	if ((recognizer->instanceId == activeInstance.instanceId) && (recognizer->modelInstanceId == activeInstance.modelInstanceId))
+	metricsAdd(METRIC_CHUNKS, 1);
+	
+	// silence alone does not compete for a worker, an owner still learns about its results
+	if ((sampleCount == 0) && (recognizer->queuedCount == 0))
 	{
-		activeInstance.activeTime.tv_sec  = currTime.tv_sec;
-		activeInstance.activeTime.tv_usec = currTime.tv_usec;
-		acceptInstance = 1;
+		worker = activeWorker(recognizer);
 	}
 	else
 	{
-		// last active instance wasn't active for at least 1..2 seconds, so make this instance the active one
-		if (abs((int) activeInstance.activeTime.tv_sec - (int) 	currTime.tv_sec) > 2)
+		worker = scheduleWorker(recognizer);
+	}
+	
+	if (worker != NULL)
+	{
+		pthread_mutex_lock(&worker->mutex);
+		
+		// another instance may have taken it over meanwhile
+		if (workerOwnedBy(worker, recognizer) != 0)
 		{
-			printf("Changing active instance form %d:%d to %d:%d.\n", activeInstance.instanceId, activeInstance.modelInstanceId, recognizer->instanceId, recognizer->modelInstanceId);
-			activeInstance.instanceId      = recognizer->instanceId;
-			activeInstance.modelInstanceId = recognizer->modelInstanceId;
-			activeInstance.activeTime.tv_sec  = currTime.tv_sec;
-			activeInstance.activeTime.tv_usec = currTime.tv_usec;
-			acceptInstance = 1;
+			logDebug("ACCEPT (worker %d, backlog %d ms, queued %d ms)\n", worker->workerId, worker->backlog * 1000 / RECOGNIZER_SAMPLE_RATE,
+				recognizer->queuedCount * 1000 / RECOGNIZER_SAMPLE_RATE);
+			
+			retVal = feedSession(recognizer, worker, samples, sampleCount);
+			fed = 1;
 		}
+		
+		pthread_mutex_unlock(&worker->mutex);
+	}
+	
+	if ((fed == 0) && (sampleCount > 0))
+	{
+		queueSamples(recognizer, samples, sampleCount);
+		metricsAdd(METRIC_CHUNKS_QUEUED, 1);
+		logDebug("QUEUE (instance %d, queued %d ms)\n", recognizer->instanceId, recognizer->queuedCount * 1000 / RECOGNIZER_SAMPLE_RATE);
+	}
+	
+	metricsObserve(METRIC_ACCEPT_SECONDS, metricsTime() - start);
+	
+	// the utterance ended when the worker was taken away
+	if ((retVal == 0) && (heldTextPending(recognizer) != 0))
+	{
+		retVal = 1;
 	}
 	
-	return acceptInstance;
+	// "partial" while waiting
+	return retVal;
+}
+
+///////////////////////////////////////////////
+static void reserveInput(VoskRecognizer *recognizer, int inputCount)
+{
+	if (inputCount > recognizer->inputSize)
+	{
+		recognizer->input = (float*) realloc(recognizer->input, inputCount * sizeof(float));
+		recognizer->inputSize = inputCount;
+	}
 }
 
 ///////////////////////////////////////////////
 //
-// re-use the model API for spawning the recognizer
-// 
-// the vosk server spawns one model only, so this works
+// "main" function that handles almost everything
 //
 //////////////////////////////////////////////
-VoskModel *vosk_model_new(const char *model_path)
+int vosk_recognizer_accept_waveform(VoskRecognizer *recognizer, const char *data, int length)
 {
-	VoskModel* instance;
-	printf("vosk_model_new, path=%s, instance=%d.\n", model_path, voskModelInstanceId);
+	const unsigned char *bytes = (const unsigned char*) data;
+	int inputCount;
+	int converted = 0;
 	
-	instance = (VoskModel*) malloc(sizeof(VoskModel));
-	instance->instanceId = voskModelInstanceId;
+	logDebug("vosk_recognizer_accept_waveform, instance=%d, modelInstaceId=%d, length=%d, sampleRate=%.2f.\n", recognizer->instanceId, recognizer->modelInstanceId, length, recognizer->inputSampleRate);
+	
+	/*
+	printf("%02X %02X %02X %02X %02X %02X %02X %02X\n",
+		data[0], data[1], data[2], data[3],
+		data[4], data[5], data[6], data[7]);
+		*/
+	
+	inputCount = (length + recognizer->hasPendingByte) / 2;
+	reserveInput(recognizer, inputCount);
 	
-	// start the thread for the recognizer here (assure one instance only)
-	if (voskModelInstanceId == 1)
+	// in real life jitsi sends aligned packets only, but other clients may
+	// split a sample between two chunks
+	if ((recognizer->hasPendingByte != 0) && (length > 0))
 	{
-		int retVal = pthread_create(&instance->recognizerThreadId,
-			NULL,
-			recognizerThread,
-			NULL);
+		unsigned char split[2] = { recognizer->pendingByte, bytes[0] };
 		
-		if (retVal != 0)
-		{
-			printf("recognizer thread start error: %d.\n", retVal);	
-		}
+		pcmToFloatScalar(split, 1, recognizer->input);
+		
+		bytes++;
+		length--;
+		converted = 1;
+		recognizer->hasPendingByte = 0;
 	}
 	
-	voskModelInstanceId++;
-	return instance;
+	pcmToFloat(bytes, length / 2, recognizer->input + converted);
+	
+	if ((length % 2) != 0)
+	{
+		recognizer->pendingByte    = bytes[length - 1];
+		recognizer->hasPendingByte = 1;
+	}
+	
+	return acceptSamples(recognizer, recognizer->input, inputCount);
 }
 
 ///////////////////////////////////////////////
 //
-// likely to be never called by the server
-// 
+// length is the number of samples
+//
 //////////////////////////////////////////////
-void vosk_model_free(VoskModel *model)
+int vosk_recognizer_accept_waveform_s(VoskRecognizer *recognizer, const short *data, int length)
 {
-	printf("vosk_model_free, instance=%d\n", model->instanceId);
-
-	// destroying the last model shall also end the recognizer thread
-	if (voskModelInstanceId == 2)
-	{
-		recognizer_exit();
-		
-		int retVal = pthread_join(model->recognizerThreadId, NULL);
-
-		if (retVal != 0)
-		{
-			printf("recognizer thread join error: %d.\n", retVal);	
-		}
-	}
+	logDebug("vosk_recognizer_accept_waveform_s, instance=%d, modelInstaceId=%d, length=%d, sampleRate=%.2f.\n", recognizer->instanceId, recognizer->modelInstanceId, length, recognizer->inputSampleRate);
 	
-	free(model);
+	reserveInput(recognizer, length);
 	
-	voskModelInstanceId--;
+	// shorts in memory are little endian on all platforms this runs on, so the byte kernel fits
+	pcmToFloat((const unsigned char*) data, length, recognizer->input);
+	
+	return acceptSamples(recognizer, recognizer->input, length);
 }
 
 ///////////////////////////////////////////////
 //
-// every server session creates one recognizer instance
+// length is the number of samples, which have to be scaled to -1.0 .. +1.0 already
+// (the portaudio float32 format the recognizer reads)
 //
-// e.g. one conference member == one session == one instance
+// 16kHz input goes to the recognizer's ring without any conversion
 //
-// sample rate is set by the server (and defined as environment on the command line)
-// 
 //////////////////////////////////////////////
-VoskRecognizer *vosk_recognizer_new(VoskModel *model, float sample_rate)
+int vosk_recognizer_accept_waveform_f(VoskRecognizer *recognizer, const float *data, int length)
 {
-	VoskRecognizer* instance;
-	printf("vosk_recognizer_new, sample_rate=%.2f, instance=%d, modelInstaceId=%d.\n", sample_rate, voskRecognizerInstanceId, model->instanceId);
-	
-	instance = (VoskRecognizer*) malloc(sizeof(VoskRecognizer));
-	instance->instanceId = voskRecognizerInstanceId;
-	instance->modelInstanceId = model->instanceId;
-	instance->inputSampleRate = sample_rate;
+	logDebug("vosk_recognizer_accept_waveform_f, instance=%d, modelInstaceId=%d, length=%d, sampleRate=%.2f.\n", recognizer->instanceId, recognizer->modelInstanceId, length, recognizer->inputSampleRate);
 	
-	voskRecognizerInstanceId++;
-	
-	return instance;
+	return acceptSamples(recognizer, data, length);
 }
 
-///////////////////////////////////////////////
-void vosk_recognizer_free(VoskRecognizer *recognizer)
+////////////////////////////////////////////////
+//
+// NULL if onlyChanges is set and the partial result did not change since the
+// last one handed out, or it changed within partialInterval
+//
+//////////////////////////////////////////////
+static const char *partialJson(VoskRecognizer *recognizer, int onlyChanges)
 {
-	printf("vosk_recognizer_free, instance=%d\n", recognizer->instanceId);
+	RecognizerWorker *worker;
+	const char *text = NULL;
+	const char *result = NULL;
+	double now;
 	
-	free(recognizer);
+	// only serve the active instance, waiting ones have nothing decoded yet
+	worker = activeWorker(recognizer);
 	
-	voskRecognizerInstanceId--;
+	if (worker != NULL)
+	{
+		pthread_mutex_lock(&worker->mutex);
+		
+		// do not return partial result if VAD is off
+		if (workerOwnedBy(worker, recognizer) != 0)
+		{
+			text = workerText(worker, WORKER_PARTIAL);
+		}
+	}
+	
+	if (text == NULL)
+	{
+		text = "";
+	}
+	
+	if (strcmp(text, recognizer->partialText) != 0)
+	{
+		now = metricsTime();
+		
+		if ((onlyChanges == 0) || (now - recognizer->partialTime >= partialInterval))
+		{
+			logDebug("Partial result=%s.\n", text);
+			metricsAdd(METRIC_RESULTS_PARTIAL, 1);
+			
+			setPartial(recognizer, text);
+			recognizer->partialTime = now;
+			result = jsonResult(&recognizer->partial, "{ \"partial\" : \"\" }");
+		}
+	}
+	else if (onlyChanges == 0)
+	{
+		result = jsonResult(&recognizer->partial, "{ \"partial\" : \"\" }");
+	}
+	
+	if (result == NULL)
+	{
+		metricsAdd(METRIC_PARTIALS_SKIPPED, 1);
+	}
+	
+	if (worker != NULL)
+	{
+		pthread_mutex_unlock(&worker->mutex);
+	}
+	
+	return result;
 }
 
-///////////////////////////////////////////////
-void vosk_recognizer_set_max_alternatives(VoskRecognizer *recognizer, int max_alternatives)
+const char *vosk_recognizer_partial_result(VoskRecognizer *recognizer)
 {
-	// stub
-	printf("vosk_recognizer_set_max_alternatives, instance=%d, max_alternatives=%d.\n", recognizer->instanceId, max_alternatives);
+	logDebug("vosk_recognizer_partial_result, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
+	return partialJson(recognizer, 0);
 }
 
-///////////////////////////////////////////////
-void vosk_recognizer_set_words(VoskRecognizer *recognizer, int words)
+const char *vosk_dlabpro_partial_result_changes(VoskRecognizer *recognizer)
 {
-	// stub
-	printf("vosk_recognizer_set_words, instance=%d, words=%d.\n", recognizer->instanceId, words);
+	logDebug("vosk_dlabpro_partial_result_changes, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
+	return partialJson(recognizer, 1);
 }
 
+////////////////////////////////////////////////
+const char *result_text_empty="{ \"text\" : \"\" }";
+
 ///////////////////////////////////////////////
 //
-// "main" function that handles almost everything 
-// 
+// WORKER_RESULT after the VAD went off, WORKER_FINAL at the end of the stream
+// (which waits for a worker if audio is still queued)
+//
 //////////////////////////////////////////////
-int vosk_recognizer_accept_waveform(VoskRecognizer *recognizer, const char *data, int length)
+static const char *setResult(VoskRecognizer *recognizer, const char *text)
 {
-	int retVal;
+	logDebug("Result=%s.\n", text);
+	metricsAdd(METRIC_RESULTS_FINAL, 1);
 	
-	printf("vosk_recognizer_accept_waveform, instance=%d, modelInstaceId=%d, length=%d, sampleRate=%.2f.\n", recognizer->instanceId, recognizer->modelInstanceId, length, recognizer->inputSampleRate);
+	jsonBufferClear(&recognizer->result);
+	jsonBufferAppend(&recognizer->result, "{ \"text\" : \"");
+	// decorate the "final" result
+	jsonBufferAppend(&recognizer->result, "-- ");
+	jsonBufferAppendEscaped(&recognizer->result, text);
+	jsonBufferAppend(&recognizer->result, " --");
+	jsonBufferAppend(&recognizer->result, "\" }");
 	
-	/*
-	printf("%02X %02X %02X %02X %02X %02X %02X %02X\n",
-		data[0], data[1], data[2], data[3],
-		data[4], data[5], data[6], data[7]);
-		*/
+	// the next utterance starts with an empty partial result, no need to send it
+	setPartial(recognizer, "");
+	
+	return jsonResult(&recognizer->result, "{ \"text\" : \"\" }");
+}
+
+static const char *resultJson(VoskRecognizer *recognizer, int type)
+{
+	RecognizerWorker *worker;
+	const char *result = result_text_empty;
+	char *held = takeHeldText(recognizer);
+	int heldSize = (held != NULL) ? strlen(held) + 1 : 0;
+	
+	// its utterance was ended when it lost the worker, that is the result
+	if ((held != NULL) && (type == WORKER_RESULT))
+	{
+		result = setResult(recognizer, held);
+		free(held);
+		return result;
+	}
 	
 	// only serve the active instance
-	if (checkActiveInstance(recognizer) == 1)
+	worker = (type == WORKER_FINAL) ? finalWorker(recognizer) : activeWorker(recognizer);
+	
+	if (worker != NULL)
 	{
-		int idleCtr = recognizer_get_idle_counter();
-		int busyCtr = recognizer_get_busy_counter();
+		const char *text = NULL;
+		
+		pthread_mutex_lock(&worker->mutex);
 		
-		// TODO idle ctr != 0 should be sticky!
-		if (idleCtr != 0)
+		if (workerOwnedBy(worker, recognizer) != 0)
 		{
-			int dataLength = 0;
-			int callbackCalled = 0;
-			
-			printf("ACCEPT\n");
-			
-			// FIXME how to handle unaligned data?
-			// in real life jitsi sends aligned packets only 
-			while (dataLength < length)
+			if ((type == WORKER_FINAL) && (recognizer->queuedCount > 0))
 			{
-				// data from jitsi is 16 bit integers in little endian
-				short value = (short) ((data[dataLength] & 0xFF) | ((data[dataLength + 1] & 0xFF) << 8));
-				float fValue = (float) value;
-				
-				// float32 format for portaudio means values are between -1.0 and +1.0, so do the scaling here
-				fValue /= 32768;
-				
-				/*
-				if (audioCallbackBufferPtr < 10)
-				{
-					printf("(%02X %02X) %.2f ", data[dataLength], data[dataLength + 1], fValue);
-				}
-				if (audioCallbackBufferPtr == 10)
-				{
-					printf("\n");	
-				}
-				*/
-				
-				// only some sampling rates are supported at all				
-				if ((recognizer->inputSampleRate != 8000.0) && (recognizer->inputSampleRate != 16000.0)
-					&& (recognizer->inputSampleRate != 48000.0))
-				{
-					printf("Error! Unsupported sample rate=%.2f!\n", recognizer->inputSampleRate);	
-				}
-				
-				audioCallbackBuffer[audioCallbackBufferPtr] = fValue;
-				audioCallbackBufferPtr++;
-				
-				// double all samples for 8kHz input rate
-				if (recognizer->inputSampleRate == 8000.0)
-				{
-					audioCallbackBuffer[audioCallbackBufferPtr] = fValue;
-					audioCallbackBufferPtr++;
-				}
-				
-				// emulate portaudio callback 
-				if (audioCallbackBufferPtr == PABUF_SIZE)
-				{
-					audioStreamCallback(audioCallbackBuffer, NULL, PABUF_SIZE, NULL, 0, audioStreamUserData);
-					audioCallbackBufferPtr = 0;
-					callbackCalled = 1;
-				}
-				
-				dataLength += 2;
-				
-				// do an ugly downsampling for 48Khz input rate (use one, skip 2)
-				if (recognizer->inputSampleRate == 48000.0)
-				{
-					dataLength += 4;					
-				}
+				feedSession(recognizer, worker, NULL, 0);
 			}
 			
-			// there might be occasions where no data was sent to recognizer, so check that first to avoid an endless loop
-			if (callbackCalled != 0)
-			{
-				// emulate a blocking call, so check that the recognizer is busy first and then idle again 				
-				while (recognizer_get_busy_counter() == busyCtr)
-				{
-					printf("+");
-					usleep(1000);
-				}
-				printf("\n");
-				
-				idleCtr = recognizer_get_idle_counter();
-				
-				while (recognizer_get_idle_counter() == idleCtr)
-				{
-					printf("-");
-					usleep(1000);
-				}
-				printf("\n");
-	
-				// decide whether to announce a "final" result
-				if (recognizer_get_vad_status() == 1)
-				{
-					printf("O ");
-					
-					// we always need more data if VAD is active
-					audioDecodingStatus = 1;
-					retVal = 0;
-				}
-				else
-				{
-					// check if VAD was active before, if yes, we have a result
-					if (audioDecodingStatus == 1) 
-					{
-						retVal = 1;	
-					}
-					else
-					{
-						retVal = 0;	
-					}
-					
-					audioDecodingStatus = 0;
-				}
-			}
-			else
+			text = workerText(worker, type);
+		}
+		
+		if (held != NULL)
+		{
+			if (text != NULL)
 			{
-				// there wasn't even enough data to send to the recognizer
-				retVal = 0;
+				storeText(&held, &heldSize, text, 1);
 			}
+			
+			text = held;
 		}
-		else
+		
+		if (text != NULL)
 		{
-			printf("IGNORE (not online)\n");
-			
-			// dunno what to return, try "partial"
-			retVal = 0;
+			result = setResult(recognizer, text);
 		}
+		
+		pthread_mutex_unlock(&worker->mutex);
 	}
-	else
+	else if (held != NULL)
 	{
-		printf("REJECT\n");
-		
-		// dunno what to return, try "partial"
-		retVal = 0;
+		result = setResult(recognizer, held);
 	}
 	
-	return retVal;
+	free(held);
+	
+	return result;
 }
 
-////////////////////////////////////////////////
-const char *partial_result_text_empty="{ \"partial\" : \"\" }";
-
-const char *vosk_recognizer_partial_result(VoskRecognizer *recognizer)
+const char *vosk_recognizer_result(VoskRecognizer *recognizer)
 {
-	printf("vosk_recognizer_partial_result, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
-	
-	// only serve the active instace
-	// do not return partial result if VAD is off
-	if ((checkActiveInstance(recognizer) == 1) && (recognizer_get_vad_status() == 1))
-	{
-		resultBuffer[0] = 0;
-		
-		printf("Partial result=%s.\n", recognizer_partial_result());
-		
-		strcat(resultBuffer, "{ \"partial\" : \"");
-		strcat(resultBuffer, recognizer_partial_result());
-		strcat(resultBuffer, "\" }");
-		
-		return resultBuffer;
-	}
-	else
-	{
-		return partial_result_text_empty;
-	}
+	logDebug("vosk_recognizer_result, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
+	return resultJson(recognizer, WORKER_RESULT);
 }
 
 ////////////////////////////////////////////////
-const char *result_text_empty="{ \"text\" : \"\" }";
-
-const char *vosk_recognizer_result(VoskRecognizer *recognizer)
+const char *vosk_recognizer_final_result(VoskRecognizer *recognizer)
 {
-	printf("vosk_recognizer_result, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
+	// decode what is still queued, then the same as a regular result
+	logDebug("vosk_recognizer_final_result, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
+	return resultJson(recognizer, WORKER_FINAL);
+}
 
-	// only serve the active instace
-	if (checkActiveInstance(recognizer) == 1)
+////////////////////////////////////////////////
+//
+// the current utterance is dropped: queued audio is not decoded, the recognizer
+// ends the utterance without handing out its text, the next one starts afresh
+//
+//////////////////////////////////////////////
+void vosk_recognizer_reset(VoskRecognizer *recognizer)
+{
+	RecognizerWorker *worker = activeWorker(recognizer);
+	
+	logDebug("vosk_recognizer_reset, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
+	
+	metricsAdd(METRIC_QUEUE_DROPPED_SAMPLES, recognizer->queuedCount);
+	recognizer->queuedCount = 0;
+	recognizer->queuedPeak  = 0.0f;
+	free(takeHeldText(recognizer));
+	
+	if (worker != NULL)
 	{
-		resultBuffer[0] = 0;
-		
-		printf("Result=%s.\n", recognizer_final_result());
-		
-		strcat(resultBuffer, "{ \"text\" : \"");
-		// decorate the "final" result
-		strcat(resultBuffer, "-- ");
-		strcat(resultBuffer, recognizer_final_result());
-		strcat(resultBuffer, " --");
-		strcat(resultBuffer, "\" }");
+		pthread_mutex_lock(&worker->mutex);
 		
-		recognizer_flush_results();
+		if (workerOwnedBy(worker, recognizer) != 0)
+		{
+			workerText(worker, WORKER_FINAL);
+		}
 		
-		return resultBuffer;
-	}
-	else
-	{
-		return result_text_empty;
+		pthread_mutex_unlock(&worker->mutex);
 	}
+	
+	resamplerReset(&recognizer->resampler);
+	voiceFilterFree(&recognizer->voiceFilter);
+	voiceFilterInit(&recognizer->voiceFilter, voiceFilterThresholdDb, voiceFilterHangoverMs, voiceFilterPrerollMs);
+	setPartial(recognizer, "");
 }
 
-////////////////////////////////////////////////
-const char *vosk_recognizer_final_result(VoskRecognizer *recognizer)
-{
-	// no special handling required, just forward
-	printf("vosk_recognizer_final_result, instance=%d, modelInstaceId=%d\n", recognizer->instanceId, recognizer->modelInstanceId);
-	return vosk_recognizer_result(recognizer);
-}
 
 //////////////////////////////////////////////////////////////////
 //
@@ -527,7 +3483,7 @@ PaError Pa_OpenStream( PaStream** stream,
 	
 	// this is the only format that the dlabpro recognizer accepts
 	assert(inputParameters->sampleFormat == paFloat32);
-	assert(sampleRate == 16000.0);
+	assert(sampleRate == RECOGNIZER_SAMPLE_RATE);
 	
 	return paNoError;
 }
@@ -544,10 +3500,10 @@ PaError Pa_OpenDefaultStream( PaStream** stream,
 {
 	audioStreamCallback = streamCallback;
 	audioStreamUserData = userData;
-
+	
 	// this is the only format that the dlabpro recognizer accepts
 	assert(sampleFormat == paFloat32);
-	assert(sampleRate == 16000.0);
+	assert(sampleRate == RECOGNIZER_SAMPLE_RATE);
 	
 	return paNoError;
 }
@@ -0,0 +1,88 @@
+//////////////////////////////////////////////
+//
+// checks controlMessageParse() against the text messages clients send,
+// and against some they should not
+//
+// usage: control_message_test (exits with 1 if a case fails)
+//
+//////////////////////////////////////////////
+
+#include "control_message.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct TestCase
+{
+	const char *text;
+	ControlType type;
+	float       sampleRate;
+	int         maxAlternatives;
+	int         words;
+} TestCase;
+
+static const TestCase testCases[] =
+{
+	// what the Vosk clients send
+	{ "{\"config\" : {\"sample_rate\" : 8000}}",                          CONTROL_CONFIG,  8000.0f, -1, -1 },
+	{ "{\"config\" : {\"sample_rate\" : 48000.0, \"words\" : true}}",     CONTROL_CONFIG, 48000.0f, -1,  1 },
+	{ "{\"config\" : {\"max_alternatives\" : 3, \"phrase_list\" : [\"a\", \"b\"]}}", CONTROL_CONFIG, -1.0f, 3, -1 },
+	{ "{\"config\" : {}}",                                                CONTROL_CONFIG,  -1.0f, -1, -1 },
+	{ "{\"eof\" : 1}",                                                    CONTROL_EOF,     -1.0f, -1, -1 },
+	{ " { \"eof\":true } \n",                                             CONTROL_EOF,     -1.0f, -1, -1 },
+	{ "{\"reset\" : 1}",                                                  CONTROL_RESET,   -1.0f, -1, -1 },
+	{ "{\"stats\" : 1}",                                                  CONTROL_STATS,   -1.0f, -1, -1 },
+	{ "{\"id\" : \"x\", \"stats\" : 2}",                                  CONTROL_STATS,   -1.0f, -1, -1 },
+	{ "{\"eof\" : 0, \"reset\" : 1}",                                     CONTROL_RESET,   -1.0f, -1, -1 },
+	
+	// commands which are switched off are none
+	{ "{\"eof\" : 0}",                                                    CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"eof\" : false}",                                                CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"eof\" : null}",                                                 CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"reset\" : 0}",                                                  CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"reset\" : false}",                                              CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"reset\" : null}",                                               CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"stats\" : 0}",                                                  CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"stats\" : false}",                                              CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"stats\" : null}",                                               CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"eof\" : \"1\"}",                                                CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"eof\" : {}}",                                                   CONTROL_INVALID, -1.0f, -1, -1 },
+	
+	// not a control message
+	{ "",                                                                 CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "eof",                                                              CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"eof\" : 1",                                                     CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"eof\" : 1} x",                                                  CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"hello\" : 1}",                                                  CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"config\" : {\"sample_rate\" : -8000}}",                         CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"config\" : 16000}",                                             CONTROL_INVALID, -1.0f, -1, -1 },
+	{ "{\"a\" : [[[[[[[[[[1]]]]]]]]]], \"eof\" : 1}",                     CONTROL_INVALID, -1.0f, -1, -1 },
+};
+
+//////////////////////////////////////////////
+int main(void)
+{
+	int count = (int) (sizeof(testCases) / sizeof(testCases[0]));
+	int failed = 0;
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		const TestCase *test = &testCases[i];
+		ControlMessage message;
+		int valid = controlMessageParse(test->text, (int) strlen(test->text), &message);
+		
+		if ((valid != (test->type != CONTROL_INVALID)) || (message.type != test->type) ||
+			((test->type == CONTROL_CONFIG) && ((message.sampleRate != test->sampleRate) ||
+			(message.maxAlternatives != test->maxAlternatives) || (message.words != test->words))))
+		{
+			printf("FAILED: %s -> type %d, sample rate %.0f, max alternatives %d, words %d\n", test->text,
+				(int) message.type, message.sampleRate, message.maxAlternatives, message.words);
+			failed++;
+		}
+	}
+	
+	printf("%d of %d cases passed\n", count - failed, count);
+	
+	return (failed == 0) ? 0 : 1;
+}
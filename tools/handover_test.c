@@ -0,0 +1,129 @@
+//////////////////////////////////////////////
+//
+// checks against the mock recognizer that a worker taken over from an idle
+// session does not carry that session's utterance over to the next one:
+// A stops sending in the middle of an utterance, B takes the only worker
+// over, A still gets its text and B none of it
+//
+// usage: handover_test (exits with 1 if it fails)
+//
+//////////////////////////////////////////////
+
+#include "vosk_api.h"
+#include "vosk_dlabpro_wrapper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define SAMPLE_RATE 16000
+#define CHUNK       (SAMPLE_RATE / 10)
+
+// longer than the scheduler lets a session hold a worker without audio
+#define IDLE_US     2500000
+
+static short voiced[CHUNK];
+static short silent[CHUNK];
+
+// the text of a result, "" if there is none
+static void resultText(const char *json, char *text, int size)
+{
+	const char *start = strstr(json, "-- ");
+	const char *end = (start != NULL) ? strstr(start + 3, " --") : NULL;
+	
+	text[0] = 0;
+	
+	if (end != NULL)
+	{
+		snprintf(text, size, "%.*s", (int) (end - start - 3), start + 3);
+	}
+}
+
+// feeds chunks of audio, collects the results in texts
+static void feed(VoskRecognizer *recognizer, const short *chunk, int chunks, char *texts, int size)
+{
+	char text[256];
+	int i;
+	
+	for (i = 0; i < chunks; i++)
+	{
+		if (vosk_recognizer_accept_waveform_s(recognizer, chunk, CHUNK) != 0)
+		{
+			resultText(vosk_recognizer_result(recognizer), text, sizeof(text));
+			snprintf(texts + strlen(texts), size - strlen(texts), "[%s]", text);
+		}
+	}
+}
+
+//////////////////////////////////////////////
+int main(void)
+{
+	char config[] = "/tmp/handover_test.XXXXXX";
+	char textsA[1024] = "", textsB[1024] = "";
+	char text[256];
+	VoskModel *model;
+	VoskRecognizer *a, *b;
+	int fd, i;
+	
+	for (i = 0; i < CHUNK; i++)
+	{
+		voiced[i] = (short) (8000.0 * sin(2.0 * M_PI * 150.0 * i / SAMPLE_RATE));
+	}
+	
+	// the mock ignores the configuration, it only has to be there
+	fd = mkstemp(config);
+	close(fd);
+	
+	setenv("MOCK_DECODE_US", "200", 0);
+	
+	vosk_dlabpro_set_workers(1);
+	vosk_dlabpro_set_voice_filter(0, -50.0f, 1000, 300);
+	model = vosk_model_new(config);
+	
+	if ((model == NULL) || (vosk_dlabpro_warm_up(200, 10000) == 0))
+	{
+		printf("FAILED: no recognizer\n");
+		return 1;
+	}
+	
+	a = vosk_recognizer_new(model, SAMPLE_RATE);
+	b = vosk_recognizer_new(model, SAMPLE_RATE);
+	
+	// A goes silent in the middle of its utterance
+	feed(a, voiced, 10, textsA, sizeof(textsA));
+	usleep(IDLE_US);
+	
+	// B takes the worker over and says something
+	feed(b, voiced, 10, textsB, sizeof(textsB));
+	feed(b, silent, 10, textsB, sizeof(textsB));
+	resultText(vosk_recognizer_final_result(b), text, sizeof(text));
+	snprintf(textsB + strlen(textsB), sizeof(textsB) - strlen(textsB), "[%s]", text);
+	
+	resultText(vosk_recognizer_final_result(a), text, sizeof(text));
+	snprintf(textsA + strlen(textsA), sizeof(textsA) - strlen(textsA), "[%s]", text);
+	
+	vosk_recognizer_free(a);
+	vosk_recognizer_free(b);
+	vosk_model_free(model);
+	unlink(config);
+	
+	printf("A: %s\nB: %s\n", textsA, textsB);
+	
+	if (strcmp(textsA, "[]") == 0)
+	{
+		printf("FAILED: A lost its utterance\n");
+		return 1;
+	}
+	
+	if (strstr(textsB, textsA) != NULL)
+	{
+		printf("FAILED: B got the text of A\n");
+		return 1;
+	}
+	
+	printf("passed\n");
+	
+	return 0;
+}
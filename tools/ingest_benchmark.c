@@ -0,0 +1,137 @@
+
+//////////////////////////////////////////////
+//
+// compares the int16 -> float ingest kernels against the former
+// per sample loop of vosk_recognizer_accept_waveform()
+//
+// usage: ingest_benchmark [samples per chunk] [iterations]
+//
+//////////////////////////////////////////////
+
+#include "pcm_convert.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+//////////////////////////////////////////////
+//
+// the loop as it was, including the sample rate check per sample
+//
+//////////////////////////////////////////////
+static float legacySampleRate = 16000.0;
+
+static void legacyLoop(const char *data, int length, float *output)
+{
+	int dataLength = 0;
+	int i = 0;
+	
+	while (dataLength < length)
+	{
+		short value = (short) ((data[dataLength] & 0xFF) | ((data[dataLength + 1] & 0xFF) << 8));
+		float fValue = (float) value;
+		
+		fValue /= 32768;
+		
+		if ((legacySampleRate != 8000.0) && (legacySampleRate != 16000.0)
+			&& (legacySampleRate != 48000.0))
+		{
+			printf("Error! Unsupported sample rate=%.2f!\n", legacySampleRate);
+		}
+		
+		output[i++] = fValue;
+		dataLength += 2;
+	}
+}
+
+//////////////////////////////////////////////
+static double now(void)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//////////////////////////////////////////////
+static float maxDifference(const float *a, const float *b, int count)
+{
+	float maxDiff = 0.0f;
+	int i;
+	
+	for (i = 0; i < count; i++)
+	{
+		if (fabsf(a[i] - b[i]) > maxDiff)
+		{
+			maxDiff = fabsf(a[i] - b[i]);
+		}
+	}
+	
+	return maxDiff;
+}
+
+//////////////////////////////////////////////
+int main(int argc, char *argv[])
+{
+	// 20ms at 16kHz is what jitsi sends
+	int samples    = (argc > 1) ? atoi(argv[1]) : 320;
+	int iterations = (argc > 2) ? atoi(argv[2]) : 200000;
+	unsigned char *data = (unsigned char*) malloc(2 * samples + 1);
+	float *reference = (float*) malloc(samples * sizeof(float));
+	float *output = (float*) malloc(samples * sizeof(float));
+	double start, legacyTime, scalarTime, simdTime;
+	int i;
+	
+	srand(1);
+	
+	for (i = 0; i < 2 * samples + 1; i++)
+	{
+		data[i] = (unsigned char) rand();
+	}
+	
+	start = now();
+	for (i = 0; i < iterations; i++)
+	{
+		legacyLoop((const char*) data, 2 * samples, reference);
+		__asm__ volatile ("" : : "r" (reference) : "memory");
+	}
+	legacyTime = now() - start;
+	
+	start = now();
+	for (i = 0; i < iterations; i++)
+	{
+		pcmToFloatScalar(data, samples, output);
+		__asm__ volatile ("" : : "r" (output) : "memory");
+	}
+	scalarTime = now() - start;
+	
+	printf("scalar: max difference %g\n", maxDifference(reference, output, samples));
+	
+	// misaligned on purpose, chunks from the network come at any offset
+	start = now();
+	for (i = 0; i < iterations; i++)
+	{
+		pcmToFloat(data + 1, samples, output);
+		__asm__ volatile ("" : : "r" (output) : "memory");
+	}
+	simdTime = now() - start;
+	
+	pcmToFloat(data, samples, output);
+	printf("%s: max difference %g\n", pcmToFloatImplementation(), maxDifference(reference, output, samples));
+	
+	printf("{ \"samples\" : %d, \"iterations\" : %d, \"legacy_ns_per_sample\" : %.3f, \"scalar_ns_per_sample\" : %.3f, "
+		"\"%s_ns_per_sample\" : %.3f, \"speedup\" : %.1f }\n",
+		samples, iterations,
+		legacyTime * 1e9 / ((double) samples * iterations),
+		scalarTime * 1e9 / ((double) samples * iterations),
+		pcmToFloatImplementation(), simdTime * 1e9 / ((double) samples * iterations),
+		legacyTime / simdTime);
+	
+	free(data);
+	free(reference);
+	free(output);
+	
+	return 0;
+}
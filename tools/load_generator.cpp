@@ -0,0 +1,503 @@
+//------------------------------------------------------------------------------
+//
+// Load generator for asr_server: opens N websocket streams, sends WAV files
+// at real-time (or accelerated) pace like a jitsi client does and reports
+// result latencies, rejected audio and real-time factor as JSON
+//
+// All streams run on one io_context with a few threads (one per core by
+// default), like the server itself, so thousands of streams do not need
+// thousands of threads.
+//
+// usage: load_generator [-n streams] [-s speed] [-c chunk ms] [-m model] [-t threads] <host> <port> <wav file>...
+//
+//------------------------------------------------------------------------------
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace beast = boost::beast;         // from <boost/beast.hpp>
+namespace http = beast::http;           // from <boost/beast/http.hpp>
+namespace websocket = beast::websocket; // from <boost/beast/websocket.hpp>
+namespace net = boost::asio;            // from <boost/asio.hpp>
+using tcp = boost::asio::ip::tcp;       // from <boost/asio/ip/tcp.hpp>
+using Clock = std::chrono::steady_clock;
+
+//------------------------------------------------------------------------------
+
+struct Wav
+{
+    std::string name;
+    int sample_rate = 0;
+    std::vector<char> pcm;  // 16 bit little endian mono
+};
+
+struct Options
+{
+    std::string host;
+    std::string port;
+    int streams = 1;
+    double speed = 1.0;  // 1 is real-time, 0 sends as fast as the connection takes it
+    int chunk_ms = 200;
+    std::string target = "/";  // the URL path selects the model
+    int threads = 0;  // of the io_context, 0 is one per core
+};
+
+// Collected by all streams
+struct Results
+{
+    std::mutex mutex;
+    std::vector<double> partial_latencies;
+    std::vector<double> final_latencies;
+    std::vector<double> realtime_factors;
+    double audio_seconds = 0;
+    int failed = 0;
+};
+
+//------------------------------------------------------------------------------
+
+static uint32_t read_le(const unsigned char *p, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+// Only what the server takes: PCM, 16 bit, mono
+static bool load_wav(const std::string &name, Wav &wav)
+{
+    std::ifstream in(name, std::ios::binary);
+    std::vector<unsigned char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0)
+    {
+        std::cerr << name << ": not a WAV file\n";
+        return false;
+    }
+
+    bool format_ok = false;
+    size_t pos = 12;
+    while (pos + 8 <= data.size())
+    {
+        uint32_t size = read_le(&data[pos + 4], 4);
+        const unsigned char *body = &data[pos + 8];
+        size_t available = std::min<size_t>(size, data.size() - pos - 8);
+
+        if (memcmp(&data[pos], "fmt ", 4) == 0 && available >= 16)
+        {
+            format_ok = read_le(body, 2) == 1 && read_le(body + 2, 2) == 1 && read_le(body + 14, 2) == 16;
+            wav.sample_rate = read_le(body + 4, 4);
+        }
+        else if (memcmp(&data[pos], "data", 4) == 0)
+        {
+            wav.pcm.assign(body, body + (available & ~size_t(1)));
+        }
+
+        pos += 8 + size + (size & 1);
+    }
+
+    if (!format_ok || wav.pcm.empty())
+    {
+        std::cerr << name << ": need 16 bit mono PCM audio\n";
+        return false;
+    }
+
+    wav.name = name;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Counters of the server, empty if /metrics cannot be read
+static std::map<std::string, double> scrape_metrics(const Options &options)
+{
+    std::map<std::string, double> values;
+
+    try
+    {
+        net::io_context ioc;
+        tcp::resolver resolver(ioc);
+        beast::tcp_stream stream(ioc);
+        stream.connect(resolver.resolve(options.host, options.port));
+
+        http::request<http::empty_body> req{http::verb::get, "/metrics", 11};
+        req.set(http::field::host, options.host);
+        http::write(stream, req);
+
+        beast::flat_buffer buffer;
+        http::response<http::string_body> res;
+        http::read(stream, buffer, res);
+
+        std::istringstream lines(res.body());
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            std::istringstream fields(line);
+            std::string name;
+            double value;
+            if (line.empty() || line[0] == '#' || !(fields >> name >> value))
+                continue;
+            values[name] = value;
+        }
+
+        beast::error_code ec;
+        stream.socket().shutdown(tcp::socket::shutdown_both, ec);
+    }
+    catch (std::exception const &e)
+    {
+        std::cerr << "metrics: " << e.what() << "\n";
+    }
+
+    return values;
+}
+
+//------------------------------------------------------------------------------
+
+// One websocket stream: audio goes out paced by a timer, results are read as
+// they come, the server may merge partial results, so there is not one per chunk.
+// Its handlers run on a strand of its own, the io_context has several threads.
+class stream_client : public std::enable_shared_from_this<stream_client>
+{
+    const Options &options_;
+    const Wav &wav_;
+    Results &results_;
+    tcp::resolver resolver_;
+    websocket::stream<beast::tcp_stream> ws_;
+    net::steady_timer timer_;
+    beast::flat_buffer buffer_;
+    std::string config_;
+    std::string eof_;
+    size_t chunk_bytes_;
+    size_t offset_ = 0;
+    size_t chunk_ = 0;
+    bool eof_sent_ = false;
+    bool failed_ = false;
+    Clock::time_point begin_;
+
+    // Send time of the newest audio chunk, a result counts from the last chunk it
+    // could answer (silent chunks draw no reply, the config and eof none either)
+    Clock::time_point last_audio_;
+    bool audio_sent_ = false;
+    std::vector<double> partial_latencies_;
+    std::vector<double> final_latencies_;
+
+public:
+    stream_client(net::any_io_executor ex, const Options &options, const Wav &wav, Results &results)
+        : options_(options), wav_(wav), results_(results), resolver_(ex), ws_(ex), timer_(ex),
+          chunk_bytes_(size_t(wav.sample_rate) * options.chunk_ms / 1000 * 2)
+    {
+        // The preamble process_chunk() filters out
+        config_ = "{\"config\" : {\"sample_rate\" : " + std::to_string(wav.sample_rate) + "}}";
+        eof_ = "{\"eof\" : 1}";
+    }
+
+    void
+    run(Clock::time_point start)
+    {
+        timer_.expires_at(start);
+        timer_.async_wait([self = shared_from_this()](beast::error_code)
+                          {
+                              self->resolver_.async_resolve(self->options_.host, self->options_.port,
+                                                            beast::bind_front_handler(&stream_client::on_resolve, self));
+                          });
+    }
+
+private:
+    void
+    on_resolve(beast::error_code ec, tcp::resolver::results_type endpoints)
+    {
+        if (ec)
+            return fail(ec, "resolve");
+
+        beast::get_lowest_layer(ws_).async_connect(endpoints, beast::bind_front_handler(&stream_client::on_connect, shared_from_this()));
+    }
+
+    void
+    on_connect(beast::error_code ec, tcp::resolver::results_type::endpoint_type)
+    {
+        if (ec)
+            return fail(ec, "connect");
+
+        beast::get_lowest_layer(ws_).socket().set_option(tcp::no_delay(true));
+        beast::get_lowest_layer(ws_).expires_never();
+        ws_.async_handshake(options_.host, options_.target, beast::bind_front_handler(&stream_client::on_handshake, shared_from_this()));
+    }
+
+    void
+    on_handshake(beast::error_code ec)
+    {
+        if (ec)
+            return fail(ec, "handshake");
+
+        do_read();
+
+        begin_ = Clock::now();
+        send(net::buffer(config_), false);
+    }
+
+    void
+    send(net::const_buffer data, bool binary)
+    {
+        if (binary)
+        {
+            last_audio_ = Clock::now();
+            audio_sent_ = true;
+        }
+        ws_.binary(binary);
+        ws_.async_write(data, beast::bind_front_handler(&stream_client::on_write, shared_from_this()));
+    }
+
+    void
+    on_write(beast::error_code ec, std::size_t)
+    {
+        if (ec)
+            return fail(ec, "write");
+
+        if (offset_ >= wav_.pcm.size())
+        {
+            if (!eof_sent_)
+            {
+                eof_sent_ = true;
+                send(net::buffer(eof_), false);
+            }
+            return;
+        }
+
+        // Real-time pace (scaled), or as fast as the connection takes it
+        auto due = begin_;
+        if (options_.speed > 0)
+            due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(chunk_ * options_.chunk_ms / 1000.0 / options_.speed));
+
+        timer_.expires_at(due);
+        timer_.async_wait([self = shared_from_this()](beast::error_code)
+                          {
+                              size_t size = std::min(self->chunk_bytes_, self->wav_.pcm.size() - self->offset_);
+                              const char *data = self->wav_.pcm.data() + self->offset_;
+                              self->offset_ += size;
+                              self->chunk_++;
+                              self->send(net::buffer(data, size), true);
+                          });
+    }
+
+    void
+    do_read()
+    {
+        ws_.async_read(buffer_, beast::bind_front_handler(&stream_client::on_read, shared_from_this()));
+    }
+
+    void
+    on_read(beast::error_code ec, std::size_t)
+    {
+        // The server closes the stream after its final result
+        if (ec == websocket::error::closed)
+            return finish();
+
+        if (ec)
+            return fail(ec, "read");
+
+        std::string reply = beast::buffers_to_string(buffer_.data());
+        buffer_.consume(buffer_.size());
+
+        if (audio_sent_)
+        {
+            double latency = std::chrono::duration<double>(Clock::now() - last_audio_).count();
+
+            if (reply.find("\"text\"") != std::string::npos)
+                final_latencies_.push_back(latency);
+            else
+                partial_latencies_.push_back(latency);
+        }
+
+        do_read();
+    }
+
+    void
+    finish()
+    {
+        double elapsed = std::chrono::duration<double>(Clock::now() - begin_).count();
+        double audio_seconds = double(wav_.pcm.size()) / 2 / wav_.sample_rate;
+
+        std::lock_guard<std::mutex> lock(results_.mutex);
+        results_.partial_latencies.insert(results_.partial_latencies.end(), partial_latencies_.begin(), partial_latencies_.end());
+        results_.final_latencies.insert(results_.final_latencies.end(), final_latencies_.begin(), final_latencies_.end());
+        results_.realtime_factors.push_back(elapsed / audio_seconds);
+        results_.audio_seconds += audio_seconds;
+    }
+
+    void
+    fail(beast::error_code ec, const char *what)
+    {
+        if (failed_)
+            return;
+        failed_ = true;
+
+        std::cerr << wav_.name << ": " << what << ": " << ec.message() << "\n";
+
+        std::lock_guard<std::mutex> lock(results_.mutex);
+        results_.failed++;
+
+        // Ends the other operation as well
+        beast::get_lowest_layer(ws_).close();
+    }
+};
+
+//------------------------------------------------------------------------------
+
+static double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty())
+        return 0;
+
+    std::sort(values.begin(), values.end());
+    size_t rank = size_t(p / 100.0 * values.size() + 0.5);
+    return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+static void print_latencies(const char *name, std::vector<double> &values)
+{
+    printf("  \"%s\": { \"count\": %zu, \"p50_ms\": %.1f, \"p95_ms\": %.1f, \"p99_ms\": %.1f },\n", name, values.size(),
+           percentile(values, 50) * 1000, percentile(values, 95) * 1000, percentile(values, 99) * 1000);
+}
+
+static double metric_delta(std::map<std::string, double> &before, std::map<std::string, double> &after, const char *name)
+{
+    return after[name] - before[name];
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:c:m:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            options.streams = std::max(1, atoi(optarg));
+            break;
+        case 's':
+            options.speed = atof(optarg);
+            break;
+        case 'c':
+            options.chunk_ms = std::max(10, atoi(optarg));
+            break;
+        case 'm':
+            options.target = std::string("/") + optarg;
+            break;
+        case 't':
+            options.threads = std::max(0, atoi(optarg));
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if (argc - optind < 3)
+    {
+        std::cerr << "Usage: load_generator [-n streams] [-s speed] [-c chunk ms] [-m model] [-t threads] <host> <port> <wav file>...\n"
+                  << "Example:\n"
+                  << "    load_generator -n 20 -s 1 127.0.0.1 2700 test.wav\n"
+                  << "    (-s 0 sends as fast as the connection takes it, -t 0 runs one thread per core)\n";
+        return EXIT_FAILURE;
+    }
+
+    options.host = argv[optind];
+    options.port = argv[optind + 1];
+
+    std::vector<Wav> wavs;
+    for (int i = optind + 2; i < argc; ++i)
+    {
+        Wav wav;
+        if (!load_wav(argv[i], wav))
+            return EXIT_FAILURE;
+        wavs.push_back(std::move(wav));
+    }
+
+    auto metrics_before = scrape_metrics(options);
+
+    if (options.threads == 0)
+        options.threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    // Streams start spread over one chunk, so they do not send in lockstep
+    Results results;
+    net::io_context ioc{options.threads};
+    auto start = Clock::now();
+    for (int i = 0; i < options.streams; ++i)
+    {
+        auto offset = std::chrono::duration<double>(options.chunk_ms / 1000.0 * i / options.streams);
+        std::make_shared<stream_client>(net::make_strand(ioc), options, wavs[i % wavs.size()], results)
+            ->run(start + std::chrono::duration_cast<Clock::duration>(offset));
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(options.threads - 1);
+    for (int i = options.threads - 1; i > 0; --i)
+        threads.emplace_back(
+            [&ioc]
+            {
+                ioc.run();
+            });
+    ioc.run();
+    for (auto &thread : threads)
+        thread.join();
+    double wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    auto metrics_after = scrape_metrics(options);
+
+    double mean_rtf = 0;
+    for (double rtf : results.realtime_factors)
+        mean_rtf += rtf / results.realtime_factors.size();
+
+    printf("{\n");
+    printf("  \"streams\": %d, \"speed\": %.2f, \"chunk_ms\": %d,\n", options.streams, options.speed, options.chunk_ms);
+    printf("  \"completed\": %zu, \"failed\": %d,\n", results.realtime_factors.size(), results.failed);
+    printf("  \"audio_seconds\": %.1f, \"wall_seconds\": %.1f,\n", results.audio_seconds, wall_seconds);
+    print_latencies("partial_latency", results.partial_latencies);
+    print_latencies("final_latency", results.final_latencies);
+
+    // Stream time per audio time, 1/speed is the best possible
+    printf("  \"realtime_factor\": %.3f", mean_rtf);
+
+    // The server does not tell the client about dropped audio, its metrics do
+    if (!metrics_after.empty())
+    {
+        double chunks = metric_delta(metrics_before, metrics_after, "vosk_chunks_total");
+        double queued = metric_delta(metrics_before, metrics_after, "vosk_chunks_queued_total");
+        double ignored = metric_delta(metrics_before, metrics_after, "vosk_chunks_ignored_total");
+        double dropped = metric_delta(metrics_before, metrics_after, "vosk_queue_dropped_seconds_total") + ignored * options.chunk_ms / 1000.0;
+        double audio = metric_delta(metrics_before, metrics_after, "vosk_audio_seconds_total");
+        double decode = metric_delta(metrics_before, metrics_after, "vosk_decode_seconds_total");
+        double sent = metric_delta(metrics_before, metrics_after, "vosk_sent_bytes_total");
+
+        printf(",\n  \"queued_chunk_ratio\": %.4f", chunks > 0 ? queued / chunks : 0.0);
+        printf(",\n  \"dropped_audio_ratio\": %.4f", results.audio_seconds > 0 ? dropped / results.audio_seconds : 0.0);
+        printf(",\n  \"decode_realtime_factor\": %.3f", audio > 0 ? decode / audio : 0.0);
+        printf(",\n  \"result_bytes_per_stream\": %.0f", options.streams > 0 ? sent / options.streams : 0.0);
+    }
+    printf("\n}\n");
+
+    return results.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
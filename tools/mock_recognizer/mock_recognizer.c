@@ -0,0 +1,372 @@
+
+//////////////////////////////////////////////
+//
+// deterministic stand-in for the dLabPro recognizer, for benchmarking
+// and debugging the wrapper without the real recognizer
+//
+// it opens the (fake) portaudio stream like the recognizer does, detects
+// "speech" by the energy of each block and answers with scripted
+// transcripts, decoding a block costs a configurable amount of time
+//
+// configured by environment:
+//
+//   MOCK_DECODE_US         time per block in microseconds (default 2000)
+//   MOCK_DECODE_JITTER_US  up to this much more per block, pseudo random (default 0)
+//   MOCK_SEED              seed for the jitter, same seed -> same timing (default 1)
+//   MOCK_VAD_THRESHOLD     RMS of a block counting as speech (default 0.01)
+//   MOCK_VAD_HANGOVER      silent blocks until an utterance ends (default 8)
+//   MOCK_BLOCKS_PER_WORD   speech blocks per word of the partial result (default 8)
+//   MOCK_TRANSCRIPT        file with one transcript per line, used in turn for
+//                          the utterances (default: a few built-in sentences)
+//   MOCK_NOTIFY            0 to not call the state callback, like an unpatched
+//                          recognizer (default 1)
+//
+//////////////////////////////////////////////
+
+#include "recognizer_vosk_wrapper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <portaudio.h>
+
+#define MOCK_QUEUE_BLOCKS   64
+#define MOCK_TEXT_SIZE      4096
+#define MOCK_MAX_UTTERANCES 256
+
+static const char *defaultTranscripts[] =
+{
+	"hello world",
+	"this is a test of the recognizer",
+	"the quick brown fox jumps over the lazy dog",
+};
+
+//////////////////////////////////////////////
+//
+// configuration
+//
+//////////////////////////////////////////////
+static int   decodeMicroseconds = 2000;
+static int   jitterMicroseconds = 0;
+static unsigned int randomState = 1;
+static float vadThreshold = 0.01f;
+static int   vadHangover = 8;
+static int   blocksPerWord = 8;
+static int   notifyState = 1;
+
+// see recognizer_set_state_callback()
+static recognizer_state_callback stateCallback = NULL;
+
+static char *transcripts[MOCK_MAX_UTTERANCES];
+static int   transcriptCount = 0;
+static int   transcriptIndex = 0;
+
+//////////////////////////////////////////////
+//
+// state, counters are read by other threads
+//
+//////////////////////////////////////////////
+static int busyCounter = 0;
+static int idleCounter = 0;
+static int vadStatus = 0;
+static int quit = 0;
+
+static char partialText[MOCK_TEXT_SIZE] = "";
+static char finalText[MOCK_TEXT_SIZE] = "";
+
+// RMS of the blocks passed to the callback, waiting to be "decoded"
+static float queue[MOCK_QUEUE_BLOCKS];
+static int   queueHead = 0;
+static int   queueLength = 0;
+static int   droppedBlocks = 0;
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queueCond = PTHREAD_COND_INITIALIZER;
+
+//////////////////////////////////////////////
+static int envInt(const char *name, int fallback)
+{
+	const char *value = getenv(name);
+	
+	return (value != NULL) ? atoi(value) : fallback;
+}
+
+static void loadTranscripts(void)
+{
+	const char *name = getenv("MOCK_TRANSCRIPT");
+	FILE *file = (name != NULL) ? fopen(name, "r") : NULL;
+	char line[MOCK_TEXT_SIZE];
+	unsigned int i;
+	
+	if (file != NULL)
+	{
+		while ((transcriptCount < MOCK_MAX_UTTERANCES) && (fgets(line, sizeof(line), file) != NULL))
+		{
+			line[strcspn(line, "\r\n")] = 0;
+			
+			if (line[0] != 0)
+			{
+				transcripts[transcriptCount++] = strdup(line);
+			}
+		}
+		
+		fclose(file);
+	}
+	else if (name != NULL)
+	{
+		printf("Mock recognizer cannot read %s, using the built-in transcripts.\n", name);
+	}
+	
+	if (transcriptCount == 0)
+	{
+		for (i = 0; i < sizeof(defaultTranscripts) / sizeof(char*); i++)
+		{
+			transcripts[transcriptCount++] = strdup(defaultTranscripts[i]);
+		}
+	}
+}
+
+//////////////////////////////////////////////
+//
+// the first words of the current transcript
+//
+//////////////////////////////////////////////
+static void copyWords(char *text, const char *transcript, int words)
+{
+	const char *end = transcript;
+	
+	while ((words > 0) && (*end != 0))
+	{
+		end += strspn(end, " ");
+		end += strcspn(end, " ");
+		words--;
+	}
+	
+	snprintf(text, MOCK_TEXT_SIZE, "%.*s", (int) (end - transcript), transcript);
+}
+
+static void setState(int *counter)
+{
+	recognizer_state_callback callback = __atomic_load_n(&stateCallback, __ATOMIC_ACQUIRE);
+	
+	__atomic_add_fetch(counter, 1, __ATOMIC_SEQ_CST);
+	
+	if ((notifyState != 0) && (callback != NULL))
+	{
+		callback();
+	}
+}
+
+//////////////////////////////////////////////
+//
+// like a real portaudio callback: must not block and must not keep the pointer
+//
+//////////////////////////////////////////////
+static int audioCallback(const void *input, void *output, unsigned long frameCount,
+	const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData)
+{
+	const float *samples = (const float*) input;
+	double energy = 0.0;
+	unsigned long i;
+	
+	for (i = 0; i < frameCount; i++)
+	{
+		energy += samples[i] * samples[i];
+	}
+	
+	pthread_mutex_lock(&queueMutex);
+	
+	if (queueLength < MOCK_QUEUE_BLOCKS)
+	{
+		queue[(queueHead + queueLength) % MOCK_QUEUE_BLOCKS] = (float) sqrt(energy / frameCount);
+		queueLength++;
+		pthread_cond_signal(&queueCond);
+	}
+	else
+	{
+		droppedBlocks++;
+	}
+	
+	pthread_mutex_unlock(&queueMutex);
+	
+	return paContinue;
+}
+
+//////////////////////////////////////////////
+static void decodeBlock(float rms, int *speechBlocks, int *silentBlocks)
+{
+	int cost = decodeMicroseconds;
+	
+	// deterministic jitter, a linear congruential generator
+	if (jitterMicroseconds > 0)
+	{
+		randomState = randomState * 1103515245u + 12345u;
+		cost += (randomState >> 16) % (jitterMicroseconds + 1);
+	}
+	
+	if (cost > 0)
+	{
+		usleep(cost);
+	}
+	
+	if (rms >= vadThreshold)
+	{
+		(*speechBlocks)++;
+		*silentBlocks = 0;
+		__atomic_store_n(&vadStatus, 1, __ATOMIC_SEQ_CST);
+		
+		copyWords(partialText, transcripts[transcriptIndex], 1 + *speechBlocks / blocksPerWord);
+	}
+	else if (vadStatus == 1)
+	{
+		(*silentBlocks)++;
+		
+		if (*silentBlocks >= vadHangover)
+		{
+			// end of the utterance, the whole transcript is the final result
+			snprintf(finalText, MOCK_TEXT_SIZE, "%s", transcripts[transcriptIndex]);
+			transcriptIndex = (transcriptIndex + 1) % transcriptCount;
+			
+			*speechBlocks = 0;
+			__atomic_store_n(&vadStatus, 0, __ATOMIC_SEQ_CST);
+		}
+	}
+}
+
+//////////////////////////////////////////////
+int recognizer_main(int argc, char** argv)
+{
+	PaStream *stream;
+	int speechBlocks = 0;
+	int silentBlocks = 0;
+	int decodedBlocks = 0;
+	const char *config = "-";
+	int i;
+	
+	// the configuration is not read, only reported
+	for (i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "-cfg") == 0)
+		{
+			config = argv[i + 1];
+		}
+	}
+	
+	decodeMicroseconds = envInt("MOCK_DECODE_US", decodeMicroseconds);
+	jitterMicroseconds = envInt("MOCK_DECODE_JITTER_US", jitterMicroseconds);
+	randomState        = envInt("MOCK_SEED", randomState);
+	vadHangover        = envInt("MOCK_VAD_HANGOVER", vadHangover);
+	blocksPerWord      = envInt("MOCK_BLOCKS_PER_WORD", blocksPerWord);
+	notifyState        = envInt("MOCK_NOTIFY", notifyState);
+	
+	if (getenv("MOCK_VAD_THRESHOLD") != NULL)
+	{
+		vadThreshold = atof(getenv("MOCK_VAD_THRESHOLD"));
+	}
+	
+	if (blocksPerWord < 1)
+	{
+		blocksPerWord = 1;
+	}
+	
+	loadTranscripts();
+	
+	Pa_Initialize();
+	Pa_OpenDefaultStream(&stream, 1, 0, paFloat32, 16000, PABUF_SIZE, audioCallback, NULL);
+	Pa_StartStream(stream);
+	
+	printf("Mock recognizer online, config %s, %d us per block (+%d us jitter), %d transcripts.\n", config, decodeMicroseconds, jitterMicroseconds, transcriptCount);
+	
+	// online
+	setState(&idleCounter);
+	
+	pthread_mutex_lock(&queueMutex);
+	
+	while (quit == 0)
+	{
+		float rms;
+		
+		if (queueLength == 0)
+		{
+			pthread_cond_wait(&queueCond, &queueMutex);
+			continue;
+		}
+		
+		rms = queue[queueHead];
+		queueHead = (queueHead + 1) % MOCK_QUEUE_BLOCKS;
+		queueLength--;
+		
+		pthread_mutex_unlock(&queueMutex);
+		
+		setState(&busyCounter);
+		decodeBlock(rms, &speechBlocks, &silentBlocks);
+		decodedBlocks++;
+		setState(&idleCounter);
+		
+		pthread_mutex_lock(&queueMutex);
+	}
+	
+	pthread_mutex_unlock(&queueMutex);
+	
+	Pa_StopStream(stream);
+	Pa_CloseStream(stream);
+	Pa_Terminate();
+	
+	printf("Mock recognizer done, %d blocks decoded, %d dropped.\n", decodedBlocks, droppedBlocks);
+	
+	return 0;
+}
+
+//////////////////////////////////////////////
+void recognizer_set_state_callback(recognizer_state_callback callback)
+{
+	__atomic_store_n(&stateCallback, callback, __ATOMIC_RELEASE);
+}
+
+//////////////////////////////////////////////
+void recognizer_exit(void)
+{
+	pthread_mutex_lock(&queueMutex);
+	quit = 1;
+	pthread_cond_signal(&queueCond);
+	pthread_mutex_unlock(&queueMutex);
+}
+
+int recognizer_get_idle_counter(void)
+{
+	return __atomic_load_n(&idleCounter, __ATOMIC_SEQ_CST);
+}
+
+int recognizer_get_busy_counter(void)
+{
+	return __atomic_load_n(&busyCounter, __ATOMIC_SEQ_CST);
+}
+
+int recognizer_get_vad_status(void)
+{
+	return __atomic_load_n(&vadStatus, __ATOMIC_SEQ_CST);
+}
+
+//////////////////////////////////////////////
+//
+// the wrapper reads the results while the recognizer is idle
+//
+//////////////////////////////////////////////
+const char* recognizer_partial_result(void)
+{
+	return partialText;
+}
+
+const char* recognizer_final_result(void)
+{
+	return finalText;
+}
+
+void recognizer_flush_results(void)
+{
+	partialText[0] = 0;
+	finalText[0] = 0;
+}
@@ -0,0 +1,40 @@
+/* Interface of the dLabPro recognizer as used by the Vosk API wrapper,
+   stand-in for programs/recognizer/recognizer_vosk_wrapper.h of dLabPro_vosk_api
+   when building against the mock recognizer */
+
+#ifndef RECOGNIZER_VOSK_WRAPPER_H
+#define RECOGNIZER_VOSK_WRAPPER_H
+
+// samples per portaudio callback, keep in sync with the real recognizer
+#define PABUF_SIZE 512
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// runs the recognizer until recognizer_exit() is called
+int recognizer_main(int argc, char** argv);
+void recognizer_exit(void);
+
+// incremented whenever the recognizer starts (busy) or finishes (idle) decoding a block,
+// the idle counter is not 0 once the recognizer accepts audio
+int recognizer_get_idle_counter(void);
+int recognizer_get_busy_counter(void);
+
+// called by the recognizer thread right after it changed one of the counters, NULL for none;
+// optional, the wrapper polls the counters if the recognizer does not have it
+typedef void (*recognizer_state_callback)(void);
+void recognizer_set_state_callback(recognizer_state_callback callback);
+
+// 1 while speech is detected
+int recognizer_get_vad_status(void);
+
+const char* recognizer_partial_result(void);
+const char* recognizer_final_result(void);
+void recognizer_flush_results(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECOGNIZER_VOSK_WRAPPER_H */